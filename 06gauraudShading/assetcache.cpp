@@ -0,0 +1,158 @@
+#include <cstdio>
+#include <vector>
+#include "assetcache.h"
+#include "mappedfile.h"
+
+AssetCache::AssetCache(size_t budget_bytes) : budget_(budget_bytes), bytes_(0), hits_(0), misses_(0), evictions_(0) {
+}
+
+AssetCache &AssetCache::global() {
+    static AssetCache cache;
+    return cache;
+}
+
+bool AssetCache::content_key(const std::string &path, const char *kind, std::string &key) {
+    unsigned long long size;
+    long long mtime;
+    if (!file_signature(path.c_str(), size, mtime)) return false;
+    unsigned long long hash;
+    bool known;
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::unordered_map<std::string, Source>::const_iterator it = sources_.find(path);
+        known = it!=sources_.end() && it->second.size==size && it->second.mtime==mtime;
+        if (known) hash = it->second.hash;
+    }
+    if (!known) {
+        if (!hash_file(path.c_str(), hash)) return false;
+        Source source = {size, mtime, hash};
+        std::lock_guard<std::mutex> lock(mutex_);
+        sources_[path] = source;
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), ":%016llx", hash);
+    key = std::string(kind) + buf;
+    return true;
+}
+
+std::shared_ptr<const void> AssetCache::find(const std::string &key) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, Entry>::iterator it = entries_.find(key);
+    if (it==entries_.end()) {
+        misses_++;
+        return std::shared_ptr<const void>();
+    }
+    hits_++;
+    lru_.splice(lru_.begin(), lru_, it->second.lru);
+    return it->second.asset;
+}
+
+std::shared_ptr<const void> AssetCache::insert(const std::string &key, const std::shared_ptr<const void> &asset, size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    std::unordered_map<std::string, Entry>::iterator it = entries_.find(key);
+    if (it!=entries_.end()) return it->second.asset; // another thread loaded it meanwhile
+    lru_.push_front(key);
+    Entry entry = {asset, bytes, lru_.begin()};
+    entries_[key] = entry;
+    bytes_ += bytes;
+    evict();
+    return asset;
+}
+
+void AssetCache::evict() {
+    // dropping a model can release the last outside reference to its textures, hence the repeat
+    bool progress = true;
+    while (bytes_>budget_ && progress) {
+        progress = false;
+        std::list<std::string>::iterator it = lru_.end();
+        while (bytes_>budget_ && it!=lru_.begin()) {
+            --it;
+            Entry &entry = entries_[*it];
+            if (entry.asset.use_count()>1) continue; // still in use, dropping it would free nothing
+            bytes_ -= entry.bytes;
+            evictions_++;
+            entries_.erase(*it);
+            it = lru_.erase(it);
+            progress = true;
+        }
+    }
+}
+
+TextureHandle AssetCache::texture(const std::string &path) {
+    std::string key;
+    if (!content_key(path, "texture", key)) return TextureHandle();
+    std::shared_ptr<const void> cached = find(key);
+    if (cached) return std::static_pointer_cast<const Texture>(cached);
+    TextureHandle tex = Texture::load(path);
+    if (!tex) return tex;
+    return std::static_pointer_cast<const Texture>(insert(key, tex, tex->size_bytes()));
+}
+
+// the mesh's key followed by those of the files loaded with it, '-' for the missing ones
+bool AssetCache::model_key(const std::string &path, bool bake_tangent_space, std::string &key) {
+    if (!content_key(path, bake_tangent_space ? "model-baked" : "model", key)) return false;
+    std::vector<std::string> siblings = ModelBuilder::sibling_files(path, bake_tangent_space);
+    for (size_t i=0; i<siblings.size(); i++) {
+        std::string sibling;
+        key += content_key(siblings[i], "", sibling) ? sibling : std::string(":-");
+    }
+    return true;
+}
+
+ModelHandle AssetCache::model(const std::string &path, bool bake_tangent_space) {
+    std::string key;
+    if (!model_key(path, bake_tangent_space, key)) return ModelHandle();
+    std::shared_ptr<const void> cached = find(key);
+    if (cached) return std::static_pointer_cast<const Model>(cached);
+    // loading runs unlocked: the builder fetches the model's textures through this cache
+    ModelBuilder builder;
+    if (!builder.bake_tangent_space(bake_tangent_space).load(path.c_str())) return ModelHandle();
+    ModelHandle model = builder.build();
+    return std::static_pointer_cast<const Model>(insert(key, model, model->size_bytes()));
+}
+
+std::future<ModelHandle> AssetCache::model_async(const std::string &path, bool bake_tangent_space) {
+    std::string key;
+    if (!model_key(path, bake_tangent_space, key)) {
+        std::promise<ModelHandle> failed;
+        failed.set_value(ModelHandle());
+        return failed.get_future();
+    }
+    std::shared_ptr<const void> cached = find(key);
+    if (cached) {
+        std::promise<ModelHandle> hit;
+        hit.set_value(std::static_pointer_cast<const Model>(cached));
+        return hit.get_future();
+    }
+    std::shared_ptr<std::future<ModelHandle> > loading = std::make_shared<std::future<ModelHandle> >(ModelBuilder::load_async(path, bake_tangent_space));
+    return std::async(std::launch::deferred, [this, key, loading]() {
+        ModelHandle model = loading->get();
+        if (!model) return model;
+        return std::static_pointer_cast<const Model>(insert(key, model, model->size_bytes()));
+    });
+}
+
+void AssetCache::set_budget(size_t bytes) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    budget_ = bytes;
+    evict();
+}
+
+size_t AssetCache::budget() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return budget_;
+}
+
+AssetCacheStats AssetCache::stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    AssetCacheStats s = {hits_, misses_, evictions_, bytes_, entries_.size()};
+    return s;
+}
+
+void AssetCache::clear() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    entries_.clear();
+    sources_.clear();
+    lru_.clear();
+    bytes_ = 0;
+}
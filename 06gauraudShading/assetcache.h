@@ -0,0 +1,73 @@
+#ifndef __ASSETCACHE_H__
+#define __ASSETCACHE_H__
+
+#include <string>
+#include <list>
+#include <mutex>
+#include <memory>
+#include <future>
+#include <unordered_map>
+#include "texture.h"
+#include "model.h"
+
+struct AssetCacheStats {
+    unsigned long long hits;
+    unsigned long long misses;
+    unsigned long long evictions;
+    size_t bytes;   // held by cached assets
+    size_t entries;
+};
+
+// Process-wide cache of loaded textures and models. Assets are keyed by kind and content hash,
+// so the same file reached through different paths is loaded once; a path is only rehashed when
+// its size or modification time changes. A model's key also covers its maps and skin file, so
+// equal meshes with different textures next to them are different models. Handles are shared_ptrs: when the cached bytes exceed
+// the budget, the least recently used assets nobody else holds any more are dropped.
+class AssetCache {
+private:
+    struct Source {
+        unsigned long long size;
+        long long mtime;
+        unsigned long long hash;
+    };
+    struct Entry {
+        std::shared_ptr<const void> asset;
+        size_t bytes;
+        std::list<std::string>::iterator lru;
+    };
+
+    mutable std::mutex mutex_;
+    size_t budget_;
+    size_t bytes_;
+    unsigned long long hits_, misses_, evictions_;
+    std::unordered_map<std::string, Source> sources_; // by path
+    std::unordered_map<std::string, Entry> entries_;  // by content key
+    std::list<std::string> lru_;                      // most recently used first
+
+    AssetCache(const AssetCache &);
+    AssetCache & operator =(const AssetCache &);
+
+    bool content_key(const std::string &path, const char *kind, std::string &key);
+    bool model_key(const std::string &path, bool bake_tangent_space, std::string &key);
+    std::shared_ptr<const void> find(const std::string &key);
+    std::shared_ptr<const void> insert(const std::string &key, const std::shared_ptr<const void> &asset, size_t bytes);
+    void evict();
+public:
+    explicit AssetCache(size_t budget_bytes = (size_t)512<<20);
+    static AssetCache &global();
+
+    // empty handles when the file can't be loaded
+    TextureHandle texture(const std::string &path);
+    ModelHandle model(const std::string &path, bool bake_tangent_space = false);
+    // ModelBuilder::load_async() on a miss, the model is cached once it has been assembled;
+    // ready straight away on a hit
+    std::future<ModelHandle> model_async(const std::string &path, bool bake_tangent_space = false);
+
+    void set_budget(size_t bytes);
+    size_t budget() const;
+    AssetCacheStats stats() const;
+    // forgets every asset; handles already given out stay valid
+    void clear();
+};
+
+#endif //__ASSETCACHE_H__
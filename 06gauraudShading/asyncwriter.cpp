@@ -0,0 +1,63 @@
+#include <iostream>
+#include <exception>
+#include "asyncwriter.h"
+#include "imagewriter.h"
+
+AsyncImageWriter::AsyncImageWriter(int nthreads, int max_pending, FramebufferPool *recycle) : workers(), queue(), mutex(), not_empty(), not_full(), max_pending(max_pending>0 ? max_pending : 1), recycle(recycle), stopping(false) {
+    if (nthreads<=0) nthreads = 1;
+    for (int i=0; i<nthreads; i++) {
+        workers.push_back(std::thread(&AsyncImageWriter::worker_loop, this));
+    }
+}
+
+AsyncImageWriter::~AsyncImageWriter() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    not_empty.notify_all();
+    for (size_t i=0; i<workers.size(); i++) workers[i].join();
+}
+
+std::future<bool> AsyncImageWriter::submit(std::unique_ptr<TGAImage> image, const std::string &filename) {
+    return submit(image ? std::move(*image) : TGAImage(), filename);
+}
+
+std::future<bool> AsyncImageWriter::submit(TGAImage &&image, const std::string &filename) {
+    Job job;
+    job.image = std::move(image);
+    job.filename = filename;
+    std::future<bool> res = job.done.get_future();
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        not_full.wait(lock, [this]() { return queue.size()<max_pending; });
+        queue.push_back(std::move(job));
+    }
+    not_empty.notify_one();
+    return res;
+}
+
+void AsyncImageWriter::worker_loop() {
+    for (;;) {
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            not_empty.wait(lock, [this]() { return stopping || !queue.empty(); });
+            if (queue.empty()) return; // stopping and drained
+            job = std::move(queue.front());
+            queue.pop_front();
+        }
+        not_full.notify_one();
+        // the frame goes back to the pool whether or not the writer threw, then the result is reported
+        bool ok = false;
+        std::exception_ptr error;
+        try {
+            ok = job.image.buffer() && image_writer_for(job.filename.c_str()).write(job.image, job.filename.c_str());
+        } catch (...) {
+            error = std::current_exception();
+        }
+        if (recycle) recycle->release(std::move(job.image));
+        if (error) job.done.set_exception(error);
+        else job.done.set_value(ok);
+    }
+}
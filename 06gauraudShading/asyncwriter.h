@@ -0,0 +1,49 @@
+#ifndef __ASYNCWRITER_H__
+#define __ASYNCWRITER_H__
+
+#include <string>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <memory>
+#include "tgaimage.h"
+#include "framebuffer.h"
+
+// Encodes and writes finished frames on its own threads so rendering of the next frame can go on.
+// The format follows the file extension (see image_writer_for). At most max_pending frames wait
+// in the queue: submit blocks beyond that, which bounds the memory held by frames in flight.
+// Written frames go back to the recycle pool, if any, for the next frame to reuse.
+class AsyncImageWriter {
+private:
+    struct Job {
+        TGAImage image;
+        std::string filename;
+        std::promise<bool> done;
+    };
+    std::vector<std::thread> workers;
+    std::deque<Job> queue;
+    std::mutex mutex;
+    std::condition_variable not_empty;
+    std::condition_variable not_full;
+    size_t max_pending;
+    FramebufferPool *recycle;
+    bool stopping;
+
+    void worker_loop();
+
+    AsyncImageWriter(const AsyncImageWriter &);
+    AsyncImageWriter & operator =(const AsyncImageWriter &);
+public:
+    explicit AsyncImageWriter(int nthreads=1, int max_pending=4, FramebufferPool *recycle=NULL);
+    // finishes every queued frame before returning
+    ~AsyncImageWriter();
+    // takes ownership of the frame; the future is false if the file could not be written and
+    // rethrows what the writer threw
+    std::future<bool> submit(TGAImage &&image, const std::string &filename);
+    std::future<bool> submit(std::unique_ptr<TGAImage> image, const std::string &filename);
+};
+
+#endif //__ASYNCWRITER_H__
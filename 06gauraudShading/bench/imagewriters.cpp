@@ -0,0 +1,65 @@
+// Encode throughput and output size of every ImageWriter.
+// usage: bench_writers [frame.tga ...]   (without arguments a synthetic shaded 1080p frame is used)
+#include <iostream>
+#include <fstream>
+#include <chrono>
+#include <cmath>
+#include <vector>
+#include "../tgaimage.h"
+#include "../imagewriter.h"
+
+static TGAImage synthetic_frame(int w, int h) {
+    // smooth lit gradients on a flat background, roughly what the lessons render
+    TGAImage img(w, h, TGAImage::RGB);
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            float dx = (x-w*.5f)/(h*.4f), dy = (y-h*.5f)/(h*.4f);
+            float r2 = dx*dx+dy*dy;
+            if (r2>1.f) continue;
+            float intensity = std::max(0.f, (dx+dy+std::sqrt(1.f-r2))*.577f);
+            img.set(x, y, TGAColor(255*intensity, 200*intensity, 160*intensity));
+        }
+    }
+    return img;
+}
+
+static long file_size(const char *filename) {
+    std::ifstream in(filename, std::ios::binary | std::ios::ate);
+    return in.is_open() ? (long)in.tellg() : -1;
+}
+
+int main(int argc, char** argv) {
+    std::vector<TGAImage> frames;
+    for (int i=1; i<argc; i++) {
+        TGAImage img;
+        if (img.read_tga_file(argv[i])) frames.push_back(img);
+    }
+    if (frames.empty()) frames.push_back(synthetic_frame(1920, 1080));
+
+    TGAWriter tga_raw(false), tga_rle(true);
+    QOIWriter qoi;
+    PPMWriter ppm;
+    PFMWriter pfm;
+    const ImageWriter *writers[] = {&tga_raw, &tga_rle, &qoi, &ppm, &pfm};
+    const int repeats = 5;
+
+    for (size_t f=0; f<frames.size(); f++) {
+        const TGAImage &img = frames[f];
+        double mpix = img.get_width()*img.get_height()/1e6;
+        std::cout << "frame " << f << ": " << img.get_width() << "x" << img.get_height() << "\n";
+        for (size_t k=0; k<sizeof(writers)/sizeof(writers[0]); k++) {
+            std::string filename = std::string("bench_output.") + writers[k]->name();
+            double best = 1e30;
+            for (int r=0; r<repeats; r++) {
+                std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+                writers[k]->write(img, filename.c_str());
+                std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+                best = std::min(best, std::chrono::duration<double, std::milli>(t1-t0).count());
+            }
+            long size = file_size(filename.c_str());
+            std::cout << "  " << writers[k]->name() << "\t" << best << " ms\t" << mpix/best*1e3 << " Mpix/s\t" << size << " bytes\n";
+            std::remove(filename.c_str());
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,66 @@
+// Time of resample() with its SSE kernels against resample_scalar(), per format and filter.
+// usage: bench_resample [image.tga ...]   (without arguments synthetic 1024x1024 images are used)
+#include <iostream>
+#include <chrono>
+#include <cstring>
+#include <vector>
+#include "../tgaimage.h"
+#include "../resample.h"
+
+typedef bool (*ResampleFunc)(const ImageView &, TGAImage &, int, int, ResampleFilter);
+
+static TGAImage synthetic_image(int w, int h, int bpp) {
+    TGAImage img(w, h, bpp);
+    unsigned char *p = img.buffer();
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            for (int c=0; c<bpp; c++) p[(y*w+x)*bpp+c] = (unsigned char)((x ^ y) + c*64);
+        }
+    }
+    return img;
+}
+
+static double best_ms(ResampleFunc func, const TGAImage &src, TGAImage &dst, int w, int h, ResampleFilter filter) {
+    const int repeats = 5;
+    double best = 1e30;
+    for (int r=0; r<repeats; r++) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        func(src.view(), dst, w, h, filter);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1-t0).count());
+    }
+    return best;
+}
+
+int main(int argc, char** argv) {
+    std::vector<TGAImage> images;
+    for (int i=1; i<argc; i++) {
+        TGAImage img;
+        if (img.read_tga_file(argv[i])) images.push_back(img);
+    }
+    if (images.empty()) {
+        images.push_back(synthetic_image(1024, 1024, TGAImage::GRAYSCALE));
+        images.push_back(synthetic_image(1024, 1024, TGAImage::RGB));
+        images.push_back(synthetic_image(1024, 1024, TGAImage::RGBA));
+    }
+    const ResampleFilter filters[] = {RESAMPLE_BOX, RESAMPLE_BILINEAR, RESAMPLE_LANCZOS3};
+    const char *names[] = {"box", "bilinear", "lanczos3"};
+
+    for (size_t i=0; i<images.size(); i++) {
+        TGAImage &img = images[i];
+        std::cout << "image " << i << ": " << img.get_width() << "x" << img.get_height() << ", " << img.get_bytespp() << " bpp\n";
+        // a 3:1 minification and a 2x magnification
+        const int targets[2][2] = {{img.get_width()/3, img.get_height()/3}, {img.get_width()*2, img.get_height()*2}};
+        for (int t=0; t<2; t++) {
+            for (int f=0; f<3; f++) {
+                TGAImage simd, scalar;
+                double ms_simd = best_ms(resample, img, simd, targets[t][0], targets[t][1], filters[f]);
+                double ms_scalar = best_ms(resample_scalar, img, scalar, targets[t][0], targets[t][1], filters[f]);
+                bool same = !memcmp(simd.buffer(), scalar.buffer(), (size_t)simd.get_width()*simd.get_height()*simd.get_bytespp());
+                std::cout << "  -> " << targets[t][0] << "x" << targets[t][1] << " " << names[f] << "\tsse " << ms_simd
+                          << " ms\tscalar " << ms_scalar << " ms" << (same ? "" : "\t(MISMATCH)") << "\n";
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,80 @@
+// Frustum culling time of SceneBVH against testing every box with box_visible, and the cost of keeping
+// the hierarchy up to date, on sparse scenes where few instances are in view.
+// usage: bench_scenebvh [instances ...]   (without arguments 10000 and 100000)
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include "../rasterizer.h"
+#include "../scenebvh.h"
+
+typedef std::chrono::steady_clock Clock;
+
+static double ms_since(Clock::time_point t0, int repeats) {
+    return std::chrono::duration<double, std::milli>(Clock::now()-t0).count()/repeats;
+}
+
+// unit cubes spread over a 2000x2000 plane and 100 units of depth in front of the camera
+static AABB random_instance() {
+    Vec3f c(rand()%20000/10.f-1000, rand()%20000/10.f-1000, -(rand()%1000)/10.f);
+    return AABB(c - Vec3f(1, 1, 1), c + Vec3f(1, 1, 1));
+}
+
+int main(int argc, char** argv) {
+    std::vector<int> counts;
+    for (int i=1; i<argc; i++) counts.push_back(atoi(argv[i]));
+    if (counts.empty()) {
+        counts.push_back(10000);
+        counts.push_back(100000);
+    }
+
+    Matrix view = Matrix::identity(4);
+    Rasterizer::lookat(Vec3f(0, 0, 12), Vec3f(0, 0, 0), Vec3f(0, -1, 0), view);
+    Frustum frustum = frustum_from_matrix(Rasterizer::projection(5.f, 100.f, 90.f, 400, 300)*view, false);
+    const int repeats = 100;
+
+    for (size_t c=0; c<counts.size(); c++) {
+        int n = counts[c];
+        srand(1);
+        std::vector<AABB> boxes;
+        for (int i=0; i<n; i++) boxes.push_back(random_instance());
+
+        Clock::time_point t0 = Clock::now();
+        SceneBVH bvh;
+        bvh.build(boxes);
+        double build = ms_since(t0, 1);
+
+        std::vector<int> visible;
+        t0 = Clock::now();
+        for (int r=0; r<repeats; r++) bvh.cull(frustum, visible);
+        double cull = ms_since(t0, repeats);
+
+        std::vector<int> expected;
+        t0 = Clock::now();
+        for (int r=0; r<repeats; r++) {
+            expected.clear();
+            for (int i=0; i<n; i++) {
+                if (box_visible(frustum, boxes[i].min, boxes[i].max)) expected.push_back(i);
+            }
+        }
+        double brute = ms_since(t0, repeats);
+
+        // every seventh instance moves a little, one update() each
+        t0 = Clock::now();
+        for (int i=0; i<n; i+=7) {
+            boxes[i].min.x += .5f;
+            boxes[i].max.x += .5f;
+            bvh.update(i, boxes[i]);
+        }
+        double update = ms_since(t0, 1);
+        t0 = Clock::now();
+        bvh.refit(boxes);
+        double refit = ms_since(t0, 1);
+
+        std::cout << n << " instances, " << expected.size() << " visible" << (visible==expected ? "" : " (MISMATCH)") << "\n";
+        std::cout << "  build\t" << build << " ms\n";
+        std::cout << "  cull\t" << cull << " ms\tbrute force " << brute << " ms\n";
+        std::cout << "  update\t" << update << " ms for " << (n+6)/7 << " items\trefit " << refit << " ms\n";
+    }
+    return 0;
+}
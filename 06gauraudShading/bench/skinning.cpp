@@ -0,0 +1,50 @@
+// Time of skin_vertices() per frame. bench_skinning runs the code path the renderer was configured
+// with, bench_skinning_avx the AVX one (only built when RENDERER_AVX is off).
+// usage: bench_skinning [vertices] [joints]   (100000 vertices and 64 joints by default)
+#include <iostream>
+#include <chrono>
+#include <cstdlib>
+#include <vector>
+#include "../skinning.h"
+
+int main(int argc, char** argv) {
+    int nverts = argc>1 ? atoi(argv[1]) : 100000;
+    int njoints = argc>2 ? atoi(argv[2]) : 64;
+    if (nverts<=0 || njoints<=0) {
+        std::cerr << "usage: bench_skinning [vertices] [joints]" << std::endl;
+        return 1;
+    }
+
+    // four influences everywhere, the worst case of the inner loop
+    srand(1);
+    Skin skin;
+    skin.positions.resize(nverts);
+    skin.normals.resize(nverts);
+    for (int i=0; i<nverts; i++) {
+        skin.positions.set(i, Vec3f(rand()%1000*.01f, rand()%1000*.01f, rand()%1000*.01f));
+        skin.normals.set(i, Vec3f(0, 0, 1));
+    }
+    for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+        skin.joints[k].resize(nverts);
+        skin.weights[k].assign(nverts, 1.f/SKIN_MAX_INFLUENCES);
+        for (int i=0; i<nverts; i++) skin.joints[k][i] = rand()%njoints;
+    }
+    std::vector<JointMatrix> palette;
+    for (int j=0; j<njoints; j++) {
+        Matrix m = Matrix::identity(4);
+        m[0][3] = j*.1f;
+        palette.push_back(joint_matrix(m));
+    }
+
+    SkinnedVertices out;
+    const int repeats = 20;
+    double best = 1e30;
+    for (int r=0; r<repeats; r++) {
+        std::chrono::steady_clock::time_point t0 = std::chrono::steady_clock::now();
+        skin_vertices(skin, palette, out);
+        std::chrono::steady_clock::time_point t1 = std::chrono::steady_clock::now();
+        best = std::min(best, std::chrono::duration<double, std::milli>(t1-t0).count());
+    }
+    std::cout << nverts << " vertices, " << njoints << " joints: " << best << " ms\t" << nverts/best/1e3 << " Mverts/s\n";
+    return 0;
+}
@@ -0,0 +1,231 @@
+#include <algorithm>
+#include <cmath>
+#include <string.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#include <xmmintrin.h>
+#endif
+#include "framebuffer.h"
+#include "threadpool.h"
+
+Vec4f HDRImage::get(int x, int y) const {
+    if (x<0 || y<0 || x>=width || y>=height) return Vec4f();
+    return TiledTarget<Vec4f>::get(x, y);
+}
+
+bool HDRImage::set(int x, int y, const Vec4f &c) {
+    if (x<0 || y<0 || x>=width || y>=height) return false;
+    at(x, y) = c;
+    return true;
+}
+
+bool HDRImage::add(int x, int y, const Vec4f &c) {
+    if (x<0 || y<0 || x>=width || y>=height) return false;
+    Vec4f &p = at(x, y);
+    p = p + c;
+    return true;
+}
+
+namespace {
+
+// tone-mapped values in [0,1] are quantized to 12 bits and looked up, which is finer than the
+// 8-bit output everywhere on the sRGB curve, so the LUT never changes a rounded result by more than one step
+const int transfer_lut_size = 4096;
+
+struct TransferLUT {
+    unsigned char srgb[transfer_lut_size];
+    unsigned char linear[transfer_lut_size];
+
+    TransferLUT() {
+        for (int i=0; i<transfer_lut_size; i++) {
+            float v = (float)i/(transfer_lut_size-1);
+            float e = v<=.0031308f ? v*12.92f : 1.055f*std::pow(v, 1.f/2.4f)-.055f;
+            srgb[i]   = (unsigned char)(e*255.f+.5f);
+            linear[i] = (unsigned char)(v*255.f+.5f);
+        }
+    }
+};
+
+const TransferLUT &transfer_lut() {
+    static const TransferLUT lut;
+    return lut;
+}
+
+inline float tonemap_scalar(float x, ToneMap op) {
+    switch (op) {
+        case TONEMAP_CLAMP:    break;
+        case TONEMAP_REINHARD: x = x/(1.f+x); break;
+        case TONEMAP_ACES:     x = (x*(2.51f*x+.03f))/(x*(2.43f*x+.59f)+.14f); break;
+    }
+    return std::min(1.f, std::max(0.f, x));
+}
+
+#ifdef __SSE2__
+inline __m128 tonemap_sse(__m128 x, ToneMap op) {
+    switch (op) {
+        case TONEMAP_CLAMP:
+            break;
+        case TONEMAP_REINHARD:
+            x = _mm_div_ps(x, _mm_add_ps(_mm_set1_ps(1.f), x));
+            break;
+        case TONEMAP_ACES: {
+            __m128 num = _mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.51f), x), _mm_set1_ps(.03f)));
+            __m128 den = _mm_add_ps(_mm_mul_ps(x, _mm_add_ps(_mm_mul_ps(_mm_set1_ps(2.43f), x), _mm_set1_ps(.59f))), _mm_set1_ps(.14f));
+            x = _mm_div_ps(num, den);
+            break;
+        }
+    }
+    // operand order matters: max/min return the second operand for NaN lanes
+    return _mm_min_ps(_mm_max_ps(x, _mm_setzero_ps()), _mm_set1_ps(1.f));
+}
+#endif
+
+}
+
+// resolves n consecutive rgba pixels into bgr bytes
+static void resolve_span(const float *p, unsigned char *q, int n, const unsigned char *lut, const ResolveSettings &settings) {
+    const float scale = transfer_lut_size-1;
+#ifdef __SSE2__
+    const __m128 exposure = _mm_set1_ps(settings.exposure);
+    const __m128 vscale = _mm_set1_ps(scale);
+    int x = 0;
+    // four pixels at a time: transposed to one vector per channel, alpha is left out
+    for (; x+4<=n; x+=4) {
+        __m128 r = _mm_loadu_ps(p+x*4), g = _mm_loadu_ps(p+x*4+4), b = _mm_loadu_ps(p+x*4+8), a = _mm_loadu_ps(p+x*4+12);
+        _MM_TRANSPOSE4_PS(r, g, b, a);
+        int idx[3][4];
+        _mm_storeu_si128((__m128i *)idx[0], _mm_cvtps_epi32(_mm_mul_ps(tonemap_sse(_mm_mul_ps(r, exposure), settings.tonemap), vscale)));
+        _mm_storeu_si128((__m128i *)idx[1], _mm_cvtps_epi32(_mm_mul_ps(tonemap_sse(_mm_mul_ps(g, exposure), settings.tonemap), vscale)));
+        _mm_storeu_si128((__m128i *)idx[2], _mm_cvtps_epi32(_mm_mul_ps(tonemap_sse(_mm_mul_ps(b, exposure), settings.tonemap), vscale)));
+        for (int i=0; i<4; i++) {
+            q[(x+i)*3+0] = lut[idx[2][i]];
+            q[(x+i)*3+1] = lut[idx[1][i]];
+            q[(x+i)*3+2] = lut[idx[0][i]];
+        }
+    }
+    // the rest one pixel per vector
+    for (; x<n; x++) {
+        __m128 c = tonemap_sse(_mm_mul_ps(_mm_loadu_ps(p+x*4), exposure), settings.tonemap);
+        int idx[4];
+        _mm_storeu_si128((__m128i *)idx, _mm_cvtps_epi32(_mm_mul_ps(c, vscale)));
+        q[x*3+0] = lut[idx[2]];
+        q[x*3+1] = lut[idx[1]];
+        q[x*3+2] = lut[idx[0]];
+    }
+#else
+    for (int x=0; x<n; x++) {
+        for (int c=0; c<3; c++) {
+            float v = tonemap_scalar(p[x*4+c]*settings.exposure, settings.tonemap);
+            q[x*3+2-c] = lut[(int)(v*scale+.5f)];
+        }
+    }
+#endif
+}
+
+void resolve(const HDRImage &src, TGAImage &dst, const ResolveSettings &settings) {
+    const int w = src.get_width(), h = src.get_height();
+    if (dst.get_width()!=w || dst.get_height()!=h || dst.get_bytespp()!=TGAImage::RGB) {
+        dst = TGAImage(w, h, TGAImage::RGB);
+    }
+    const unsigned char *lut = settings.srgb ? transfer_lut().srgb : transfer_lut().linear;
+    unsigned char background[3];
+    resolve_span(src.get_clear_value().data_, background, 1, lut, settings);
+    const float *in = (const float *)src.buffer();
+    unsigned char *out = dst.buffer();
+    const int tile = HDRImage::TILE_SIZE;
+    ThreadPool::global().parallel_for(0, h, [&](int y) {
+        unsigned char *q = out + (size_t)y*w*3;
+        for (int x0=0; x0<w; x0+=tile) {
+            int n = std::min(tile, w-x0);
+            if (src.tile_cleared(x0/tile, y/tile)) {
+                for (int x=x0; x<x0+n; x++) memcpy(q+x*3, background, 3);
+            } else {
+                resolve_span(in + ((size_t)y*w+x0)*4, q+x0*3, n, lut, settings);
+            }
+        }
+    });
+}
+
+void depth_to_image(const DepthBuffer &src, TGAImage &dst) {
+    const int w = src.get_width(), h = src.get_height();
+    if (dst.get_width()!=w || dst.get_height()!=h || dst.get_bytespp()!=TGAImage::GRAYSCALE) {
+        dst = TGAImage(w, h, TGAImage::GRAYSCALE);
+    }
+    unsigned char *out = dst.buffer();
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            out[(size_t)y*w+x] = (unsigned char)std::max(0.f, std::min(255.f, src.get(x, y)));
+        }
+    }
+}
+
+FramebufferPool::FramebufferPool(size_t max_pooled) : colors(), depths(), hdrs(), mutex(), max_pooled(max_pooled) {
+}
+
+TGAImage FramebufferPool::acquire_color(int w, int h, int bpp, bool clear) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i=0; i<colors.size(); i++) {
+            if (colors[i].get_width()==w && colors[i].get_height()==h && colors[i].get_bytespp()==bpp) {
+                TGAImage img(std::move(colors[i]));
+                colors.erase(colors.begin()+i);
+                if (clear) img.clear();
+                return img;
+            }
+        }
+    }
+    return TGAImage(w, h, bpp);
+}
+
+DepthBuffer FramebufferPool::acquire_depth(int w, int h, float value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i=0; i<depths.size(); i++) {
+            if (depths[i].get_width()==w && depths[i].get_height()==h) {
+                DepthBuffer zbuffer(std::move(depths[i]));
+                depths.erase(depths.begin()+i);
+                zbuffer.clear(value);
+                return zbuffer;
+            }
+        }
+    }
+    return DepthBuffer(w, h, value);
+}
+
+HDRImage FramebufferPool::acquire_hdr(int w, int h, const Vec4f &value) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i=0; i<hdrs.size(); i++) {
+            if (hdrs[i].get_width()==w && hdrs[i].get_height()==h) {
+                HDRImage hdr(std::move(hdrs[i]));
+                hdrs.erase(hdrs.begin()+i);
+                hdr.clear(value);
+                return hdr;
+            }
+        }
+    }
+    return HDRImage(w, h, value);
+}
+
+void FramebufferPool::release(TGAImage &&img) {
+    if (!img.buffer()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (colors.size()<max_pooled) colors.push_back(std::move(img));
+}
+
+void FramebufferPool::release(DepthBuffer &&zbuffer) {
+    if (!zbuffer.get_width()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (depths.size()<max_pooled) depths.push_back(std::move(zbuffer));
+}
+
+void FramebufferPool::release(HDRImage &&hdr) {
+    if (!hdr.get_width()) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (hdrs.size()<max_pooled) hdrs.push_back(std::move(hdr));
+}
+
+FramebufferPool &FramebufferPool::global() {
+    static FramebufferPool pool;
+    return pool;
+}
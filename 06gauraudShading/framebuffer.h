@@ -0,0 +1,144 @@
+#ifndef __FRAMEBUFFER_H__
+#define __FRAMEBUFFER_H__
+
+#include <vector>
+#include <mutex>
+#include <algorithm>
+#include "tgaimage.h"
+#include "geometry.h"
+
+// Row-major render target split into 32x32 tiles that each remember whether they still hold
+// the clear value. clear() only raises the flags, O(tiles); a tile is filled with the clear value
+// the first time it is written, and tiles that are never written are read straight from clear_value.
+template <typename T> class TiledTarget {
+public:
+    enum { TILE_SHIFT = 5, TILE_SIZE = 1<<TILE_SHIFT };
+protected:
+    int width;
+    int height;
+    int tiles_x;
+    std::vector<T> data;
+    std::vector<unsigned char> cleared; // one flag per tile
+    T clear_value;
+
+    int tile_of(int x, int y) const {
+        return (y>>TILE_SHIFT)*tiles_x + (x>>TILE_SHIFT);
+    }
+
+    void fill_tile(int t) {
+        int x0 = (t%tiles_x)<<TILE_SHIFT, y0 = (t/tiles_x)<<TILE_SHIFT;
+        int x1 = std::min(width, x0+TILE_SIZE), y1 = std::min(height, y0+TILE_SIZE);
+        for (int y=y0; y<y1; y++) {
+            std::fill(data.begin()+(size_t)y*width+x0, data.begin()+(size_t)y*width+x1, clear_value);
+        }
+        cleared[t] = 0;
+    }
+public:
+    TiledTarget() : width(0), height(0), tiles_x(0), data(), cleared(), clear_value() {}
+    TiledTarget(int w, int h, const T &value) : width(w), height(h), tiles_x((w+TILE_SIZE-1)>>TILE_SHIFT), data((size_t)w*h),
+        cleared((size_t)tiles_x*((h+TILE_SIZE-1)>>TILE_SHIFT), 1), clear_value(value) {}
+
+    void clear(const T &value) {
+        clear_value = value;
+        std::fill(cleared.begin(), cleared.end(), 1);
+    }
+
+    int get_width() const { return width; }
+    int get_height() const { return height; }
+    const T &get_clear_value() const { return clear_value; }
+
+    bool tile_cleared(int tx, int ty) const {
+        return cleared[ty*tiles_x + tx]!=0;
+    }
+
+    // element for reading; pending tiles answer with the clear value
+    const T &get(int x, int y) const {
+        return cleared[tile_of(x, y)] ? clear_value : data[(size_t)y*width+x];
+    }
+
+    // element for writing, materializing its tile first
+    T &at(int x, int y) {
+        int t = tile_of(x, y);
+        if (cleared[t]) fill_tile(t);
+        return data[(size_t)y*width+x];
+    }
+
+    // Materializes every tile overlapping the inclusive, already clipped rectangle, after which the
+    // rectangle may be accessed directly through buffer(). Rasterizers call it once per triangle bbox.
+    void touch(int x0, int y0, int x1, int y1) {
+        for (int ty=y0>>TILE_SHIFT; ty<=(y1>>TILE_SHIFT); ty++) {
+            for (int tx=x0>>TILE_SHIFT; tx<=(x1>>TILE_SHIFT); tx++) {
+                if (cleared[ty*tiles_x+tx]) fill_tile(ty*tiles_x+tx);
+            }
+        }
+    }
+
+    T *buffer() { return data.data(); }
+    const T *buffer() const { return data.data(); }
+};
+
+// float z-buffer
+class DepthBuffer : public TiledTarget<float> {
+public:
+    DepthBuffer() : TiledTarget<float>() {}
+    DepthBuffer(int w, int h, float value) : TiledTarget<float>(w, h, value) {}
+};
+
+// Linear RGBA32F render target. Shaders write unclamped radiance here and lights can be accumulated
+// with add; the 8-bit conversion happens once per pixel in resolve().
+class HDRImage : public TiledTarget<Vec4f> {
+public:
+    HDRImage() : TiledTarget<Vec4f>() {}
+    HDRImage(int w, int h, const Vec4f &value=Vec4f()) : TiledTarget<Vec4f>(w, h, value) {}
+    Vec4f get(int x, int y) const;
+    bool set(int x, int y, const Vec4f &c);
+    bool add(int x, int y, const Vec4f &c);
+};
+
+enum ToneMap {
+    TONEMAP_CLAMP,    // no curve, values above 1 saturate
+    TONEMAP_REINHARD, // x/(1+x)
+    TONEMAP_ACES      // Narkowicz's fit of the ACES filmic curve
+};
+
+struct ResolveSettings {
+    float exposure;
+    ToneMap tonemap;
+    bool srgb; // encode with the sRGB transfer curve, otherwise store linear values
+
+    ResolveSettings(float exposure=1.f, ToneMap tonemap=TONEMAP_ACES, bool srgb=true) : exposure(exposure), tonemap(tonemap), srgb(srgb) {}
+};
+
+// Exposure, tone mapping, transfer curve and packing into dst (RGB, resized if needed) in a single pass.
+// Rows are spread over the thread pool; with SSE each channel is tone mapped four pixels at a time.
+// Tiles that were never drawn to are filled with the resolved clear color without touching their pixels.
+void resolve(const HDRImage &src, TGAImage &dst, const ResolveSettings &settings=ResolveSettings());
+
+// Depth values in [0,255] as a grayscale image (dst is resized if needed), e.g. to write a z-buffer out.
+void depth_to_image(const DepthBuffer &src, TGAImage &dst);
+
+// Recycles color, depth and HDR targets across frames so steady-state rendering does not allocate.
+// Targets are moved out by acquire and moved back by release; all calls are thread-safe,
+// so an AsyncImageWriter can hand frames back from its own threads.
+class FramebufferPool {
+private:
+    std::vector<TGAImage> colors;
+    std::vector<DepthBuffer> depths;
+    std::vector<HDRImage> hdrs;
+    std::mutex mutex;
+    size_t max_pooled; // per kind, extra released targets are freed
+public:
+    explicit FramebufferPool(size_t max_pooled=8);
+    // clear=false skips the memset for targets that are about to be overwritten anyway
+    TGAImage acquire_color(int w, int h, int bpp, bool clear=true);
+    DepthBuffer acquire_depth(int w, int h, float value);
+    // cleared lazily like depth targets, in O(tiles)
+    HDRImage acquire_hdr(int w, int h, const Vec4f &value=Vec4f());
+    void release(TGAImage &&img);
+    void release(DepthBuffer &&zbuffer);
+    void release(HDRImage &&hdr);
+
+    static FramebufferPool &global();
+};
+
+#endif //__FRAMEBUFFER_H__
@@ -244,6 +244,37 @@ typedef vec<3, int>    Vec3i;
 typedef vec<4, float>  Vec4f;
 typedef vec<4, int>    Vec4i;
 
+// ----------------------------------------------------------------------------
+// Structure-of-arrays storage for float vectors: one contiguous array per
+// component, so batched code can stream x, y and z independently.
+// ----------------------------------------------------------------------------
+template <size_t DIM>
+struct vec_array {
+    std::vector<float> c[DIM];
+
+    size_t size() const { return c[0].size(); }
+    bool empty() const { return c[0].empty(); }
+    void resize(size_t n) { for (size_t k=0; k<DIM; k++) c[k].resize(n); }
+    void reserve(size_t n) { for (size_t k=0; k<DIM; k++) c[k].reserve(n); }
+    void swap(vec_array &other) { for (size_t k=0; k<DIM; k++) c[k].swap(other.c[k]); }
+
+    void push_back(const vec<DIM,float> &v) {
+        for (size_t k=0; k<DIM; k++) c[k].push_back(v[k]);
+    }
+    void set(size_t i, const vec<DIM,float> &v) {
+        for (size_t k=0; k<DIM; k++) c[k][i] = v[k];
+    }
+    vec<DIM,float> operator[](size_t i) const {
+        vec<DIM,float> v;
+        for (size_t k=0; k<DIM; k++) v[k] = c[k][i];
+        return v;
+    }
+    const float *component(size_t k) const { return c[k].data(); }
+};
+
+typedef vec_array<2> Vec2fArray;
+typedef vec_array<3> Vec3fArray;
+
 // ----------------------------------------------------------------------------
 // Stream output for 2D and 3D. For higher dims, you can write another or just use
 // an indexing loop.
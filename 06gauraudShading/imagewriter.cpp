@@ -0,0 +1,216 @@
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <string.h>
+#include "imagewriter.h"
+
+namespace {
+
+bool dump(const std::vector<unsigned char> &buf, const char *filename) {
+    if (!strcmp(filename, "-")) {
+        std::cout.write((const char *)buf.data(), buf.size());
+        std::cout.flush();
+        if (!std::cout.good()) {
+            std::cerr << "can't write to stdout\n";
+            return false;
+        }
+        return true;
+    }
+    std::ofstream out;
+    out.open(filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    out.write((const char *)buf.data(), buf.size());
+    if (!out.good()) {
+        std::cerr << "can't dump the file " << filename << "\n";
+        return false;
+    }
+    return true;
+}
+
+void put_header(std::vector<unsigned char> &out, const std::string &s) {
+    out.insert(out.end(), s.begin(), s.end());
+}
+
+void put_u32be(std::vector<unsigned char> &out, unsigned int v) {
+    out.push_back(v>>24); out.push_back(v>>16); out.push_back(v>>8); out.push_back(v);
+}
+
+}
+
+TGAWriter::TGAWriter(bool rle) : rle(rle) {
+}
+
+const char *TGAWriter::name() const {
+    return rle ? "tga-rle" : "tga";
+}
+
+bool TGAWriter::write(const TGAImage &img, const char *filename) const {
+    return img.write_tga_file(filename, rle);
+}
+
+const char *QOIWriter::name() const {
+    return "qoi";
+}
+
+void QOIWriter::encode(const ImageView &img, std::vector<unsigned char> &out) {
+    const int channels = (img.bytespp==TGAImage::RGBA ? 4 : 3);
+    out.clear();
+    // worst case is one RGBA op per pixel
+    out.reserve(14 + (size_t)img.width*img.height*(channels+1) + 8);
+    put_header(out, "qoif");
+    put_u32be(out, img.width);
+    put_u32be(out, img.height);
+    out.push_back(channels);
+    out.push_back(0); // sRGB with linear alpha
+
+    unsigned char index[64][4];
+    memset(index, 0, sizeof(index));
+    unsigned char prev[4] = {0, 0, 0, 255};
+    int run = 0;
+    size_t n = out.size();
+    out.resize(out.capacity());
+    unsigned char *dst = out.data() + n;
+    for (int y=0; y<img.height; y++) {
+        for (int x=0; x<img.width; x++) {
+            const unsigned char *p = img.pixel(x, y);
+            unsigned char px[4]; // rgba
+            if (img.bytespp==TGAImage::GRAYSCALE) {
+                px[0] = px[1] = px[2] = p[0];
+                px[3] = 255;
+            } else {
+                px[0] = p[2]; px[1] = p[1]; px[2] = p[0];
+                px[3] = (img.bytespp==TGAImage::RGBA ? p[3] : 255);
+            }
+            if (!memcmp(px, prev, 4)) {
+                if (++run==62) {
+                    *dst++ = 0xc0 | (run-1);
+                    run = 0;
+                }
+                continue;
+            }
+            if (run) {
+                *dst++ = 0xc0 | (run-1);
+                run = 0;
+            }
+            int h = (px[0]*3 + px[1]*5 + px[2]*7 + px[3]*11) & 63;
+            if (!memcmp(index[h], px, 4)) {
+                *dst++ = h;
+            } else {
+                memcpy(index[h], px, 4);
+                if (px[3]==prev[3]) {
+                    signed char dr = px[0]-prev[0];
+                    signed char dg = px[1]-prev[1];
+                    signed char db = px[2]-prev[2];
+                    signed char dr_dg = dr-dg;
+                    signed char db_dg = db-dg;
+                    if (dr>-3 && dr<2 && dg>-3 && dg<2 && db>-3 && db<2) {
+                        *dst++ = 0x40 | (dr+2)<<4 | (dg+2)<<2 | (db+2);
+                    } else if (dr_dg>-9 && dr_dg<8 && dg>-33 && dg<32 && db_dg>-9 && db_dg<8) {
+                        *dst++ = 0x80 | (dg+32);
+                        *dst++ = (dr_dg+8)<<4 | (db_dg+8);
+                    } else {
+                        *dst++ = 0xfe;
+                        *dst++ = px[0]; *dst++ = px[1]; *dst++ = px[2];
+                    }
+                } else {
+                    *dst++ = 0xff;
+                    *dst++ = px[0]; *dst++ = px[1]; *dst++ = px[2]; *dst++ = px[3];
+                }
+            }
+            memcpy(prev, px, 4);
+        }
+    }
+    if (run) *dst++ = 0xc0 | (run-1);
+    static const unsigned char end_marker[8] = {0, 0, 0, 0, 0, 0, 0, 1};
+    memcpy(dst, end_marker, 8);
+    dst += 8;
+    out.resize(dst - out.data());
+}
+
+bool QOIWriter::write(const TGAImage &img, const char *filename) const {
+    std::vector<unsigned char> buf;
+    encode(img.view(), buf);
+    return dump(buf, filename);
+}
+
+const char *PPMWriter::name() const {
+    return "ppm";
+}
+
+void PPMWriter::encode(const ImageView &img, std::vector<unsigned char> &out) {
+    const bool gray = (img.bytespp==TGAImage::GRAYSCALE);
+    out.clear();
+    put_header(out, std::string(gray ? "P5\n" : "P6\n") + std::to_string(img.width) + " " + std::to_string(img.height) + "\n255\n");
+    size_t n = out.size();
+    out.resize(n + (size_t)img.width*img.height*(gray ? 1 : 3));
+    unsigned char *dst = out.data() + n;
+    for (int y=0; y<img.height; y++) {
+        for (int x=0; x<img.width; x++) {
+            const unsigned char *p = img.pixel(x, y);
+            if (gray) {
+                *dst++ = p[0];
+            } else {
+                *dst++ = p[2]; *dst++ = p[1]; *dst++ = p[0];
+            }
+        }
+    }
+}
+
+bool PPMWriter::write(const TGAImage &img, const char *filename) const {
+    std::vector<unsigned char> buf;
+    encode(img.view(), buf);
+    return dump(buf, filename);
+}
+
+const char *PFMWriter::name() const {
+    return "pfm";
+}
+
+bool PFMWriter::write(const TGAImage &img, const char *filename) const {
+    ImageView v = img.view();
+    const int nc = (v.bytespp==TGAImage::GRAYSCALE ? 1 : 3);
+    std::vector<float> data((size_t)v.width*v.height*nc);
+    float *dst = data.data();
+    for (int y=0; y<v.height; y++) {
+        for (int x=0; x<v.width; x++) {
+            const unsigned char *p = v.pixel(x, y);
+            if (nc==1) {
+                *dst++ = p[0]/255.f;
+            } else {
+                *dst++ = p[2]/255.f; *dst++ = p[1]/255.f; *dst++ = p[0]/255.f;
+            }
+        }
+    }
+    return write(data.data(), v.width, v.height, nc, filename);
+}
+
+bool PFMWriter::write(const float *data, int width, int height, int nc, const char *filename) {
+    if (nc!=1 && nc!=3) return false;
+    std::vector<unsigned char> buf;
+    // a negative scale marks little-endian samples; rows are stored bottom-up
+    put_header(buf, std::string(nc==1 ? "Pf\n" : "PF\n") + std::to_string(width) + " " + std::to_string(height) + "\n-1.0\n");
+    size_t rowbytes = (size_t)width*nc*sizeof(float);
+    size_t n = buf.size();
+    buf.resize(n + rowbytes*height);
+    for (int y=0; y<height; y++) {
+        memcpy(buf.data() + n + (size_t)(height-1-y)*rowbytes, data + (size_t)y*width*nc, rowbytes);
+    }
+    return dump(buf, filename);
+}
+
+const ImageWriter &image_writer_for(const char *filename) {
+    static const TGAWriter tga;
+    static const QOIWriter qoi;
+    static const PPMWriter ppm;
+    static const PFMWriter pfm;
+    const char *dot = strrchr(filename, '.');
+    if (dot) {
+        if (!strcmp(dot, ".qoi")) return qoi;
+        if (!strcmp(dot, ".ppm") || !strcmp(dot, ".pgm")) return ppm;
+        if (!strcmp(dot, ".pfm")) return pfm;
+    }
+    return tga;
+}
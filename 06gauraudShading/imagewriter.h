@@ -0,0 +1,53 @@
+#ifndef __IMAGEWRITER_H__
+#define __IMAGEWRITER_H__
+
+#include <vector>
+#include "tgaimage.h"
+
+// Common interface of the output formats; "-" as a filename writes to stdout so frames can be piped.
+class ImageWriter {
+public:
+    virtual ~ImageWriter() {}
+    virtual const char *name() const = 0;
+    virtual bool write(const TGAImage &img, const char *filename) const = 0;
+};
+
+class TGAWriter : public ImageWriter {
+private:
+    bool rle;
+public:
+    explicit TGAWriter(bool rle=true);
+    const char *name() const;
+    bool write(const TGAImage &img, const char *filename) const;
+};
+
+// "Quite OK Image" format: lossless, single pass, far better than RLE on gradients.
+// Grayscale images are stored as RGB.
+class QOIWriter : public ImageWriter {
+public:
+    const char *name() const;
+    bool write(const TGAImage &img, const char *filename) const;
+    static void encode(const ImageView &img, std::vector<unsigned char> &out);
+};
+
+// binary netpbm: P5 for grayscale, P6 otherwise (alpha is dropped)
+class PPMWriter : public ImageWriter {
+public:
+    const char *name() const;
+    bool write(const TGAImage &img, const char *filename) const;
+    static void encode(const ImageView &img, std::vector<unsigned char> &out);
+};
+
+// portable float map: Pf for grayscale, PF otherwise, values in [0,1]
+class PFMWriter : public ImageWriter {
+public:
+    const char *name() const;
+    bool write(const TGAImage &img, const char *filename) const;
+    // nc is 1 or 3, rows are given top-down
+    static bool write(const float *data, int width, int height, int nc, const char *filename);
+};
+
+// writer chosen by the file extension: .qoi, .ppm/.pgm, .pfm, anything else is RLE TGA
+const ImageWriter &image_writer_for(const char *filename);
+
+#endif //__IMAGEWRITER_H__
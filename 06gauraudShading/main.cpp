@@ -8,6 +8,8 @@
 #include "model.h"
 #include "geometry.h"
 #include "rasterizer.h"
+#include "asyncwriter.h"
+#include "assetcache.h"
 // #include "matrix.h" // Include the header file that defines the Matrix type
 
 const TGAColor white = TGAColor(255, 255, 255, 255);
@@ -15,16 +17,10 @@ const TGAColor red = TGAColor(255, 0, 0, 255);
 const TGAColor green = TGAColor(0, 255, 0, 255);
 const TGAColor blue = TGAColor(0, 0, 255, 255);
 
-Model* model = NULL;
 const int width = 800;
 const int height = 800;
 const int depth = 255;
 
-Matrix ModelView;
-Matrix Projection;
-Matrix Viewport;
-
-Vec3f light_dir = Vec3f(1.0f, 1.0f, 1.0f).normalize();
 Vec3f camera(0, 0, 2);
 Vec3f center(0, 0, 0);
 Vec3f up(0, 1, 0);
@@ -34,20 +30,19 @@ struct GouraudShader : public IShader {
     Vec3f varying_ndc;   // 透视校正参数 (1/w)
     Vec3f varying_int;   // 强度值
 
-    virtual Vec4f vertex(int iface, int nthvert) {
-        Vec3f v = model->vert(iface, nthvert);
+    virtual Vec4f vertex(const RenderContext &ctx, int iface, int nthvert) {
+        Vec3f v = ctx.position(iface, nthvert);
         Vec4f gl_Vertex = embed<4>(v);
         
         // 法线变换
-        Vec3f n = proj<3, 4>(ModelView.inverse_transpose() * embed<4>(model->normal(iface, nthvert), 0.f)).normalize();
+        Vec3f n = proj<3, 4>(ctx.NormalMatrix * embed<4>(ctx.normal(iface, nthvert), 0.f)).normalize();
         // Vec3f n = model->normal(iface, nthvert);
-        light_dir = proj<3, 4>(ModelView * embed<4>(light_dir, 0.f)).normalize();
         
         // 强度计算
-        varying_int[nthvert] = std::max(0.0f, n * light_dir);
+        varying_int[nthvert] = std::max(0.0f, n * ctx.light_eye);
         
         // 坐标变换
-        gl_Vertex = Viewport * (Projection * ModelView * gl_Vertex);
+        gl_Vertex = ctx.Viewport * (ctx.Projection * ctx.ModelView * gl_Vertex);
         varying_tri.set_col(nthvert, gl_Vertex);
         varying_ndc[nthvert] = 1.0f / gl_Vertex[3];
         
@@ -70,36 +65,69 @@ struct GouraudShader : public IShader {
         // return (intensity < 0.0f) || (z < 0.0f) || (z > 1.0f);
         return false;
     }
+
+    virtual bool fragment_hdr(Vec3f bar, Vec4f& color) {
+        float w = 1.0f / (bar.x * varying_ndc.x + bar.y * varying_ndc.y + bar.z * varying_ndc.z);
+        float intensity = (bar.x * varying_int.x * varying_ndc.x +
+                          bar.y * varying_int.y * varying_ndc.y +
+                          bar.z * varying_int.z * varying_ndc.z) * w;
+        color = Vec4f(intensity, intensity, intensity, 1.f); // no clamping, resolve() deals with the range
+        return false;
+    }
 };
 
 
 
 
 int main(int argc, char** argv) {
-    model = new Model(argc > 1 ? argv[1] : "../obj/african_head/african_head.obj");
-    
-    TGAImage image(width, height, TGAImage::RGB);
-    TGAImage zbuffer(width, height, TGAImage::GRAYSCALE);
+    // geometry and maps load on the pool while the render targets are set up, unless the cache has the model
+    std::future<ModelHandle> loading = AssetCache::global().model_async(argc > 1 ? argv[1] : "../obj/african_head/african_head.obj");
+
+    // both targets are cleared per tile on first write instead of being filled up front
+    FramebufferPool &pool = FramebufferPool::global();
+    AsyncImageWriter writer(1, 4, &pool);
+    HDRImage hdr = pool.acquire_hdr(width, height);
+    DepthBuffer zbuffer = pool.acquire_depth(width, height, 0.f);
+
+    ModelHandle model = loading.get();
+    if (!model) {
+        std::cerr << "can't load model\n";
+        return 1;
+    }
 
     // 初始化矩阵
-    Rasterizer rasterizer = Rasterizer(width, height, camera, center, depth, model);
-    Rasterizer::lookat(camera, center, up, ModelView);
-    Projection = rasterizer.projection((camera - center).norm());
-    Viewport = Rasterizer::viewport(0, 0, width, height, depth);
+    Rasterizer rasterizer = Rasterizer(width, height, camera, center, depth, model.get());
+    RenderContext ctx;
+    Rasterizer::lookat(camera, center, up, ctx.ModelView);
+    ctx.Projection = rasterizer.projection((camera - center).norm());
+    ctx.Viewport = Rasterizer::viewport(0, 0, width, height, depth);
+    ctx.light_dir = Vec3f(1.0f, 1.0f, 1.0f).normalize();
+    ctx.model = model.get();
+    ctx.hdr = &hdr;
+    ctx.zbuffer = &zbuffer;
+    ctx.prepare();
 
     GouraudShader shader;
     for (int i = 0; i < model->nfaces(); i++) {
         Vec4f screen_coords[3];
         for (int j = 0; j < 3; j++) {
-            screen_coords[j] = shader.vertex(i, j);
+            screen_coords[j] = shader.vertex(ctx, i, j);
         }
-        rasterizer.triangle(screen_coords, shader, image, zbuffer);
+        rasterizer.triangle(screen_coords, shader, ctx);
     }
 
+    // a plain clamp keeps the lesson's look: intensities are written out as they are
+    TGAImage image = pool.acquire_color(width, height, TGAImage::RGB, false);
+    resolve(hdr, image, ResolveSettings(1.f, TONEMAP_CLAMP, false));
+    TGAImage depth_image = pool.acquire_color(width, height, TGAImage::GRAYSCALE, false);
+    depth_to_image(zbuffer, depth_image);
+    pool.release(std::move(hdr));
+    pool.release(std::move(zbuffer));
+
     // image.flip_vertically();
     // zbuffer.flip_vertically();
-    image.write_tga_file("../output.tga");
-    zbuffer.write_tga_file("../zbuffer.tga");
-    delete model;
-    return 0;
+    // the frames are encoded and written in the background; the futures report failures
+    std::future<bool> image_written   = writer.submit(std::move(image),   "../output.tga");
+    std::future<bool> zbuffer_written = writer.submit(std::move(depth_image), "../zbuffer.tga");
+    return image_written.get() && zbuffer_written.get() ? 0 : 1;
 }
\ No newline at end of file
@@ -0,0 +1,91 @@
+#include <iostream>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "mappedfile.h"
+
+MappedFile::MappedFile() : map(NULL), length(0) {
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+bool MappedFile::open(const char *filename) {
+    close();
+    int fd = ::open(filename, O_RDONLY);
+    if (fd<0) {
+        std::cerr << "can't open file " << filename << "\n";
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st)<0 || st.st_size<=0) {
+        ::close(fd);
+        std::cerr << "can't map empty file " << filename << "\n";
+        return false;
+    }
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd); // the mapping keeps the file alive
+    if (m==MAP_FAILED) {
+        std::cerr << "can't map file " << filename << "\n";
+        return false;
+    }
+    map = m;
+    length = st.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (map) munmap(map, length);
+    map = NULL;
+    length = 0;
+}
+
+bool MappedFile::is_open() const {
+    return map!=NULL;
+}
+
+const unsigned char *MappedFile::data() const {
+    return (const unsigned char *)map;
+}
+
+size_t MappedFile::size() const {
+    return length;
+}
+
+unsigned long long hash_bytes(const unsigned char *p, size_t n) {
+    const unsigned long long k = 0x9e3779b97f4a7c15ULL;
+    unsigned long long h = 0xcbf29ce484222325ULL ^ n;
+    size_t i = 0;
+    for (; i+8<=n; i+=8) {
+        unsigned long long w;
+        memcpy(&w, p+i, 8);
+        h = (h ^ (w*k)) * k;
+        h ^= h>>29;
+    }
+    unsigned long long tail = 0;
+    memcpy(&tail, p+i, n-i);
+    h = (h ^ (tail*k)) * k;
+    return h ^ (h>>32);
+}
+
+bool hash_file(const char *filename, unsigned long long &hash) {
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    hash = hash_bytes(file.data(), file.size());
+    return true;
+}
+
+bool file_signature(const char *filename, unsigned long long &size, long long &mtime) {
+    struct stat st;
+    if (stat(filename, &st)<0) return false;
+    size = st.st_size;
+#ifdef __linux__
+    mtime = (long long)st.st_mtim.tv_sec*1000000000LL + st.st_mtim.tv_nsec;
+#else
+    mtime = (long long)st.st_mtime*1000000000LL;
+#endif
+    return true;
+}
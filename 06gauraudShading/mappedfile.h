@@ -0,0 +1,31 @@
+#ifndef __MAPPEDFILE_H__
+#define __MAPPEDFILE_H__
+
+#include <cstddef>
+
+// Whole file mapped read-only into memory; pages are loaded on first touch.
+class MappedFile {
+private:
+    void *map;
+    size_t length;
+
+    MappedFile(const MappedFile &);
+    MappedFile & operator =(const MappedFile &);
+public:
+    MappedFile();
+    ~MappedFile();
+    bool open(const char *filename);
+    void close();
+    bool is_open() const;
+    const unsigned char *data() const;
+    size_t size() const;
+};
+
+// 64-bit multiply-rotate hash over 8-byte words, several times faster than a bytewise FNV
+unsigned long long hash_bytes(const unsigned char *p, size_t n);
+// hash of the whole file content
+bool hash_file(const char *filename, unsigned long long &hash);
+// size and modification time (nanoseconds where the platform has them)
+bool file_signature(const char *filename, unsigned long long &size, long long &mtime);
+
+#endif //__MAPPEDFILE_H__
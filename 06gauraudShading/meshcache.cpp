@@ -0,0 +1,160 @@
+#include <iostream>
+#include <fstream>
+#include <cstdio>
+#include <algorithm>
+#include <cstddef>
+#include <string.h>
+#include <unistd.h>
+#include "meshcache.h"
+#include "mappedfile.h"
+
+namespace {
+
+const char cache_magic[8] = {'T','R','M','E','S','H','\0','\0'};
+const unsigned int cache_version = 6;
+
+static_assert(sizeof(MeshVertex)==8*sizeof(float), "welded vertices are stored as packed floats");
+
+size_t payload_size(const MeshCacheHeader &h) {
+    size_t size = (size_t)h.nverts*3*sizeof(float) + (size_t)h.nuvs*2*sizeof(float) + (size_t)h.nnorms*3*sizeof(float) + (size_t)h.nindices*3*sizeof(int)
+         + (size_t)h.nvertices*sizeof(MeshVertex) + (size_t)h.nindices*sizeof(int);
+    for (unsigned int i=0; i<h.nlods && i<MESH_CACHE_MAX_LODS; i++) size += (size_t)h.lod_nindices[i]*sizeof(int);
+    return size;
+}
+
+template <typename T> const unsigned char *read_array(const unsigned char *p, std::vector<T> &v, size_t n) {
+    v.resize(n);
+    if (n) memcpy(&v[0], p, n*sizeof(T));
+    return p + n*sizeof(T);
+}
+
+template <size_t DIM> const unsigned char *read_array(const unsigned char *p, vec_array<DIM> &v, size_t n) {
+    for (size_t k=0; k<DIM; k++) p = read_array(p, v.c[k], n);
+    return p;
+}
+
+template <typename T> void write_array(std::vector<unsigned char> &buf, const std::vector<T> &v) {
+    if (v.empty()) return;
+    const unsigned char *p = (const unsigned char *)&v[0];
+    buf.insert(buf.end(), p, p+v.size()*sizeof(T));
+}
+
+template <size_t DIM> void write_array(std::vector<unsigned char> &buf, const vec_array<DIM> &v) {
+    for (size_t k=0; k<DIM; k++) write_array(buf, v.c[k]);
+}
+
+// Records the source's new mtime after its content was found unchanged, so later loads can trust the
+// signature again instead of hashing the OBJ every time. A patch of one field in place: a reader that
+// races with it at worst sees the old value and hashes once more.
+void update_source_mtime(const std::string &path, long long mtime) {
+    FILE *f = fopen(path.c_str(), "r+b");
+    if (!f) return;
+    if (fseek(f, offsetof(MeshCacheHeader, source_mtime), SEEK_SET) || fwrite(&mtime, sizeof(mtime), 1, f)!=1) {
+        std::cerr << "can't update mesh cache " << path << "\n";
+    }
+    fclose(f);
+}
+
+}
+
+std::string mesh_cache_path(const char *obj_filename) {
+    return std::string(obj_filename) + ".meshcache";
+}
+
+bool load_mesh_cache(const char *obj_filename, ObjData &out, bool verify_payload) {
+    std::string path = mesh_cache_path(obj_filename);
+    if (access(path.c_str(), R_OK)) return false; // no cache yet, not an error
+    unsigned long long size;
+    long long mtime;
+    if (!file_signature(obj_filename, size, mtime)) return false;
+    MappedFile file;
+    if (!file.open(path.c_str()) || file.size()<sizeof(MeshCacheHeader)) return false;
+    MeshCacheHeader h;
+    memcpy(&h, file.data(), sizeof(h));
+    if (memcmp(h.magic, cache_magic, sizeof(cache_magic)) || h.version!=cache_version || h.nlods>MESH_CACHE_MAX_LODS) return false;
+    if (sizeof(h)+payload_size(h)!=file.size() || h.source_size!=size) return false;
+    bool touched = h.source_mtime!=mtime;
+    if (touched) {
+        // touched but maybe not changed: only the content decides
+        unsigned long long hash;
+        if (!hash_file(obj_filename, hash) || hash!=h.source_hash) return false;
+    }
+    const unsigned char *p = file.data() + sizeof(h);
+    if (verify_payload && hash_bytes(p, payload_size(h))!=h.payload_hash) {
+        std::cerr << "corrupted mesh cache " << path << "\n";
+        return false;
+    }
+    if (touched) update_source_mtime(path, mtime);
+    p = read_array(p, out.verts, h.nverts);
+    p = read_array(p, out.uvs, h.nuvs);
+    p = read_array(p, out.norms, h.nnorms);
+    p = read_array(p, out.vidx, h.nindices);
+    p = read_array(p, out.tidx, h.nindices);
+    p = read_array(p, out.nidx, h.nindices);
+    p = read_array(p, out.vertices, h.nvertices);
+    p = read_array(p, out.indices, h.nindices);
+    out.lods.resize(h.nlods);
+    for (unsigned int i=0; i<h.nlods; i++) {
+        p = read_array(p, out.lods[i].indices, h.lod_nindices[i]);
+        out.lods[i].error = h.lod_error[i];
+    }
+    out.bbox_min = Vec3f(h.bbox_min[0], h.bbox_min[1], h.bbox_min[2]);
+    out.bbox_max = Vec3f(h.bbox_max[0], h.bbox_max[1], h.bbox_max[2]);
+    return true;
+}
+
+bool save_mesh_cache(const char *obj_filename, const ObjData &obj) {
+    if (obj.indices.size()!=obj.vidx.size()) return false; // not welded yet
+    MeshCacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, cache_magic, sizeof(cache_magic));
+    h.version  = cache_version;
+    h.nverts   = obj.verts.size();
+    h.nuvs     = obj.uvs.size();
+    h.nnorms   = obj.norms.size();
+    h.nindices = obj.vidx.size();
+    h.nvertices = obj.vertices.size();
+    h.nlods = std::min<size_t>(obj.lods.size(), MESH_CACHE_MAX_LODS);
+    for (unsigned int i=0; i<h.nlods; i++) {
+        h.lod_nindices[i] = obj.lods[i].indices.size();
+        h.lod_error[i] = obj.lods[i].error;
+    }
+    for (int k=0; k<3; k++) {
+        h.bbox_min[k] = obj.bbox_min[k];
+        h.bbox_max[k] = obj.bbox_max[k];
+    }
+    // through locals: the packed header's fields may be misaligned
+    unsigned long long source_size, source_hash;
+    long long source_mtime;
+    if (!file_signature(obj_filename, source_size, source_mtime) || !hash_file(obj_filename, source_hash)) return false;
+    h.source_size = source_size;
+    h.source_mtime = source_mtime;
+    h.source_hash = source_hash;
+
+    std::vector<unsigned char> buf(sizeof(h));
+    buf.reserve(sizeof(h) + payload_size(h));
+    write_array(buf, obj.verts);
+    write_array(buf, obj.uvs);
+    write_array(buf, obj.norms);
+    write_array(buf, obj.vidx);
+    write_array(buf, obj.tidx);
+    write_array(buf, obj.nidx);
+    write_array(buf, obj.vertices);
+    write_array(buf, obj.indices);
+    for (unsigned int i=0; i<h.nlods; i++) write_array(buf, obj.lods[i].indices);
+    h.payload_hash = hash_bytes(buf.data()+sizeof(h), buf.size()-sizeof(h));
+    memcpy(buf.data(), &h, sizeof(h));
+
+    std::string path = mesh_cache_path(obj_filename);
+    std::string tmp = path + ".tmp" + std::to_string(getpid());
+    std::ofstream out(tmp.c_str(), std::ios::binary);
+    if (!out.is_open()) return false;
+    out.write((const char *)buf.data(), buf.size());
+    out.close();
+    if (!out.good() || std::rename(tmp.c_str(), path.c_str())) {
+        std::remove(tmp.c_str());
+        std::cerr << "can't write mesh cache " << path << "\n";
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef __MESHCACHE_H__
+#define __MESHCACHE_H__
+
+#include <string>
+#include "objparser.h"
+
+// Binary cache of a parsed OBJ, stored next to it as <file>.meshcache.
+// Layout: MeshCacheHeader followed by the arrays in ObjData order (positions, uvs, normals
+// component by component as floats, the three index buffers as int32, then the welded
+// MeshVertex array, its index buffer and the LOD index buffers), all native-endian. Triangles are stored in the order
+// left by optimize_triangle_order().
+// The header records size, modification time and content hash of the OBJ it was built from,
+// so a cache is ignored as soon as its source changes, and a hash of the payload.
+#define MESH_CACHE_MAX_LODS 4
+
+#pragma pack(push,1)
+struct MeshCacheHeader {
+    char magic[8];
+    unsigned int version;
+    unsigned int nverts;
+    unsigned int nuvs;
+    unsigned int nnorms;
+    unsigned int nindices; // corners, three per triangle
+    unsigned int nvertices; // welded vertices
+    unsigned int nlods;
+    unsigned int lod_nindices[MESH_CACHE_MAX_LODS];
+    float lod_error[MESH_CACHE_MAX_LODS];
+    float bbox_min[3];
+    float bbox_max[3];
+    unsigned long long source_size;
+    long long source_mtime; // nanoseconds where the platform has them
+    unsigned long long source_hash;
+    unsigned long long payload_hash;
+};
+#pragma pack(pop)
+
+std::string mesh_cache_path(const char *obj_filename);
+
+// True if an up-to-date cache was found. The file is mapped and each array is copied out of it into
+// out, one memcpy per array: no parsing, but still time proportional to the mesh size.
+// By default only the header is checked: layout, sizes and the source's size and mtime; the OBJ is
+// hashed only when its mtime moved. verify_payload also rehashes the whole payload to catch a
+// cache damaged in place, which costs about as much again as the copies.
+bool load_mesh_cache(const char *obj_filename, ObjData &out, bool verify_payload = false);
+// expects a welded mesh; written to a temporary file and renamed into place, so readers never see a partial cache
+bool save_mesh_cache(const char *obj_filename, const ObjData &obj);
+
+#endif //__MESHCACHE_H__
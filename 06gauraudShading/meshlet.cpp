@@ -0,0 +1,113 @@
+#include <algorithm>
+#include <cmath>
+#include "meshlet.h"
+
+namespace {
+
+void finish_meshlet(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, Meshlet &m) {
+    const int *tri = &indices[m.first_index];
+    Vec3f lo = vertices[tri[0]].pos, hi = lo;
+    for (int i=0; i<m.ntriangles*3; i++) {
+        const Vec3f &p = vertices[tri[i]].pos;
+        for (int k=0; k<3; k++) {
+            lo[k] = std::min(lo[k], p[k]);
+            hi[k] = std::max(hi[k], p[k]);
+        }
+    }
+    m.center = (lo+hi)*.5f;
+    m.radius = 0.f;
+    for (int i=0; i<m.ntriangles*3; i++) m.radius = std::max(m.radius, (vertices[tri[i]].pos-m.center).norm());
+
+    // normal cone: average of the unit face normals, opened wide enough to hold all of them
+    std::vector<Vec3f> normals;
+    normals.reserve(m.ntriangles);
+    Vec3f axis;
+    for (int t=0; t<m.ntriangles; t++) {
+        const Vec3f &a = vertices[tri[t*3]].pos, &b = vertices[tri[t*3+1]].pos, &c = vertices[tri[t*3+2]].pos;
+        Vec3f n = (b-a).cross(c-a);
+        if (n.norm()<=0) continue;
+        n.normalize();
+        normals.push_back(n);
+        axis = axis + n;
+    }
+    m.cone_axis = Vec3f(0, 0, 1);
+    m.cone_cutoff = 1.f;
+    if (normals.empty() || axis.norm()<=0) return;
+    axis.normalize();
+    float mindp = 1.f;
+    for (size_t i=0; i<normals.size(); i++) mindp = std::min(mindp, axis*normals[i]);
+    m.cone_axis = axis;
+    // the normals span more than a hemisphere: some triangle always faces the camera
+    if (mindp<=.1f) return;
+    // back-facing everywhere inside the cone rotated by 90 degrees: sin(acos(mindp))
+    m.cone_cutoff = std::sqrt(1.f - mindp*mindp);
+}
+
+}
+
+void build_meshlets(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, std::vector<Meshlet> &meshlets, int max_vertices, int max_triangles) {
+    meshlets.clear();
+    const int ntris = (int)(indices.size()/3);
+    std::vector<int> seen(vertices.size(), -1); // meshlet number that last used the vertex
+    Meshlet current;
+    current.first_index = 0;
+    current.ntriangles = 0;
+    int nverts = 0;
+    for (int t=0; t<ntris; t++) {
+        int added = 0; // upper bound, a degenerate triangle may name a vertex twice
+        for (int k=0; k<3; k++) added += seen[indices[t*3+k]]!=(int)meshlets.size();
+        if (current.ntriangles==max_triangles || nverts+added>max_vertices) {
+            finish_meshlet(vertices, indices, current);
+            meshlets.push_back(current);
+            current.first_index = t*3;
+            current.ntriangles = 0;
+            nverts = 0;
+        }
+        for (int k=0; k<3; k++) {
+            int &s = seen[indices[t*3+k]];
+            if (s!=(int)meshlets.size()) {
+                s = (int)meshlets.size();
+                nverts++;
+            }
+        }
+        current.ntriangles++;
+    }
+    if (current.ntriangles) {
+        finish_meshlet(vertices, indices, current);
+        meshlets.push_back(current);
+    }
+}
+
+Frustum frustum_from_matrix(const Matrix &m, bool near_far) {
+    Frustum f;
+    f.planes[4] = f.planes[5] = Vec4f(0, 0, 0, 1); // everything is inside
+    for (int i=0; i<(near_far ? 3 : 2); i++) {
+        for (int s=0; s<2; s++) {
+            float sign = s ? -1.f : 1.f;
+            Vec4f p;
+            for (int k=0; k<4; k++) p[k] = m[3][k] + sign*m[i][k];
+            float len = Vec3f(p[0], p[1], p[2]).norm();
+            f.planes[i*2+s] = len>0 ? p*(1.f/len) : p;
+        }
+    }
+    return f;
+}
+
+bool box_visible(const Frustum &frustum, const Vec3f &min, const Vec3f &max) {
+    for (int i=0; i<6; i++) {
+        const Vec4f &p = frustum.planes[i];
+        // the corner furthest along the plane normal
+        Vec3f c(p[0]>0 ? max.x : min.x, p[1]>0 ? max.y : min.y, p[2]>0 ? max.z : min.z);
+        if (p[0]*c.x + p[1]*c.y + p[2]*c.z + p[3] < 0) return false;
+    }
+    return true;
+}
+
+bool meshlet_visible(const Meshlet &m, const Frustum &frustum, const Vec3f &camera) {
+    for (int i=0; i<6; i++) {
+        const Vec4f &p = frustum.planes[i];
+        if (p[0]*m.center.x + p[1]*m.center.y + p[2]*m.center.z + p[3] < -m.radius) return false;
+    }
+    Vec3f view = m.center - camera;
+    return view*m.cone_axis < m.cone_cutoff*view.norm() + m.radius;
+}
@@ -0,0 +1,38 @@
+#ifndef __MESHLET_H__
+#define __MESHLET_H__
+
+#include <vector>
+#include "geometry.h"
+#include "objparser.h"
+
+// A run of consecutive triangles of the welded index buffer, small enough to be culled as a unit.
+struct Meshlet {
+    int first_index;  // into the welded index buffer, three per triangle
+    int ntriangles;
+    Vec3f center;     // bounding sphere
+    float radius;
+    Vec3f cone_axis;  // average facing of the triangles
+    float cone_cutoff; // sine of the normal cone half angle; 1 disables back-face rejection
+};
+
+// Six clip planes (a, b, c, d) with unit normals pointing inwards, in the space the matrix maps from.
+struct Frustum {
+    Vec4f planes[6];
+};
+
+// Cuts the index buffer into meshlets of at most max_triangles triangles touching at most
+// max_vertices vertices. Works best on a buffer ordered by optimize_triangle_order(),
+// which keeps consecutive triangles spatially close.
+void build_meshlets(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, std::vector<Meshlet> &meshlets, int max_vertices = 64, int max_triangles = 124);
+
+// Gribb-Hartmann extraction from a projection * modelview matrix (OpenGL clip conventions).
+// Without near_far only the side planes cull, for rasterizers that don't clip depth.
+Frustum frustum_from_matrix(const Matrix &clip_from_model, bool near_far = true);
+
+// false when the axis-aligned box lies entirely behind one of the planes
+bool box_visible(const Frustum &frustum, const Vec3f &min, const Vec3f &max);
+
+// camera is the eye position in model space
+bool meshlet_visible(const Meshlet &m, const Frustum &frustum, const Vec3f &camera);
+
+#endif //__MESHLET_H__
@@ -0,0 +1,327 @@
+#include <vector>
+#include <algorithm>
+#include <limits>
+#include <cmath>
+#include "meshopt.h"
+
+namespace {
+
+inline unsigned int hash_corner(int v, int t, int n) {
+    unsigned int h = (unsigned int)v*0x9e3779b1u;
+    h = (h ^ (unsigned int)t)*0x85ebca77u;
+    h = (h ^ (unsigned int)n)*0xc2b2ae3du;
+    return h ^ (h>>16);
+}
+
+// FIFO post-transform cache: a vertex is resident while fewer than cache_size misses happened since
+// it was loaded. Advancing time by cache_size+1 flushes it.
+struct VertexCache {
+    std::vector<unsigned int> stamp;
+    unsigned int time;
+    unsigned int size;
+
+    VertexCache(size_t nvertices, int cache_size) : stamp(nvertices, 0), time(cache_size+1), size(cache_size) {}
+    bool resident(int v) const { return time-stamp[v] <= size; }
+    // number of misses (0 or 1)
+    int touch(int v) {
+        if (resident(v)) return 0;
+        stamp[v] = time++;
+        return 1;
+    }
+    int touch_triangle(const int *t) { return touch(t[0]) + touch(t[1]) + touch(t[2]); }
+    void flush() { time += size+1; }
+};
+
+int skip_dead_end(const std::vector<int> &live, std::vector<int> &dead_end, size_t &cursor) {
+    while (!dead_end.empty()) {
+        int d = dead_end.back();
+        dead_end.pop_back();
+        if (live[d]>0) return d;
+    }
+    for (; cursor<live.size(); cursor++) {
+        if (live[cursor]>0) return (int)cursor;
+    }
+    return -1;
+}
+
+// Tipsify (Sander, Nehab, Barczak 2007): fan around the vertex that is most likely still cached.
+// Returns the new triangle order; hard receives the positions where it had to jump to an unrelated vertex.
+void tipsify(const std::vector<int> &indices, size_t nvertices, int cache_size, std::vector<int> &order, std::vector<size_t> &hard) {
+    const size_t ntris = indices.size()/3;
+    std::vector<int> live(nvertices, 0);
+    for (size_t i=0; i<ntris*3; i++) live[indices[i]]++;
+    std::vector<int> offsets(nvertices+1, 0);
+    for (size_t v=0; v<nvertices; v++) offsets[v+1] = offsets[v] + live[v];
+    std::vector<int> adjacency(ntris*3);
+    std::vector<int> fill(offsets.begin(), offsets.end()-1);
+    for (size_t i=0; i<ntris*3; i++) adjacency[fill[indices[i]]++] = (int)(i/3);
+
+    VertexCache cache(nvertices, cache_size);
+    std::vector<char> emitted(ntris, 0);
+    std::vector<int> dead_end, candidates;
+    order.clear();
+    order.reserve(ntris);
+    hard.assign(1, 0);
+    size_t cursor = 0;
+    int f = skip_dead_end(live, dead_end, cursor);
+    while (f>=0) {
+        candidates.clear();
+        for (int a=offsets[f]; a<offsets[f+1]; a++) {
+            int t = adjacency[a];
+            if (emitted[t]) continue;
+            for (int k=0; k<3; k++) {
+                int v = indices[t*3+k];
+                dead_end.push_back(v);
+                candidates.push_back(v);
+                live[v]--;
+                cache.touch(v);
+            }
+            emitted[t] = 1;
+            order.push_back(t);
+        }
+        // prefer the candidate that entered the cache earliest but will still be resident after its fan
+        int best = -1, best_priority = -1;
+        for (size_t i=0; i<candidates.size(); i++) {
+            int n = candidates[i];
+            if (live[n]<=0) continue;
+            int age = (int)(cache.time-cache.stamp[n]);
+            int priority = age + 2*live[n] <= cache_size ? age : 0;
+            if (priority>best_priority) {
+                best_priority = priority;
+                best = n;
+            }
+        }
+        if (best<0) {
+            best = skip_dead_end(live, dead_end, cursor);
+            if (best>=0) hard.push_back(order.size());
+        }
+        f = best;
+    }
+}
+
+// Splits every hard cluster where the running ACMR drops to threshold times that of the whole cluster.
+void soft_boundaries(const std::vector<int> &indices, size_t nvertices, const std::vector<size_t> &hard, int cache_size, float threshold, std::vector<size_t> &clusters) {
+    const size_t ntris = indices.size()/3;
+    VertexCache cache(nvertices, cache_size);
+    clusters.clear();
+    for (size_t h=0; h<hard.size(); h++) {
+        size_t begin = hard[h], end = h+1<hard.size() ? hard[h+1] : ntris;
+        if (begin>=end) continue;
+        cache.flush();
+        int misses = 0;
+        for (size_t t=begin; t<end; t++) misses += cache.touch_triangle(&indices[t*3]);
+        float cluster_threshold = threshold*misses/(end-begin);
+
+        cache.flush();
+        clusters.push_back(begin);
+        int running_misses = 0, running_tris = 0;
+        for (size_t t=begin; t<end; t++) {
+            running_misses += cache.touch_triangle(&indices[t*3]);
+            running_tris++;
+            if (t+1<end && (float)running_misses/running_tris <= cluster_threshold) {
+                clusters.push_back(t+1);
+                cache.flush();
+                running_misses = running_tris = 0;
+            }
+        }
+    }
+}
+
+void apply_triangle_order(std::vector<int> &idx, const std::vector<int> &order) {
+    if (idx.size()!=order.size()*3) return;
+    std::vector<int> out(idx.size());
+    for (size_t i=0; i<order.size(); i++) {
+        for (int k=0; k<3; k++) out[i*3+k] = idx[order[i]*3+k];
+    }
+    idx.swap(out);
+}
+
+}
+
+float weld_vertices(ObjData &obj) {
+    const size_t ncorners = obj.vidx.size();
+    obj.vertices.clear();
+    obj.indices.resize(ncorners);
+    if (!ncorners) return 0.f;
+
+    // open addressing over corner numbers: each slot holds the first corner that produced a vertex
+    size_t capacity = 1;
+    while (capacity<2*ncorners) capacity <<= 1;
+    std::vector<int> slots(capacity, -1);
+    std::vector<int> first_corner;
+    first_corner.reserve(ncorners/2);
+    const int *vi = obj.vidx.data(), *ti = obj.tidx.data(), *ni = obj.nidx.data();
+    for (size_t c=0; c<ncorners; c++) {
+        size_t s = hash_corner(vi[c], ti[c], ni[c]) & (capacity-1);
+        while (slots[s]>=0) {
+            int f = first_corner[slots[s]];
+            if (vi[f]==vi[c] && ti[f]==ti[c] && ni[f]==ni[c]) break;
+            s = (s+1) & (capacity-1);
+        }
+        if (slots[s]<0) {
+            slots[s] = (int)first_corner.size();
+            first_corner.push_back((int)c);
+        }
+        obj.indices[c] = slots[s];
+    }
+
+    obj.vertices.resize(first_corner.size());
+    for (size_t i=0; i<first_corner.size(); i++) {
+        int c = first_corner[i];
+        MeshVertex &v = obj.vertices[i];
+        v.pos    = obj.verts[vi[c]];
+        v.uv     = obj.uvs[ti[c]];
+        v.normal = obj.norms[ni[c]];
+    }
+    return (float)ncorners/obj.vertices.size();
+}
+
+float compute_acmr(const std::vector<int> &indices, size_t nvertices, int cache_size) {
+    const size_t ntris = indices.size()/3;
+    if (!ntris) return 0.f;
+    VertexCache cache(nvertices, cache_size);
+    int misses = 0;
+    for (size_t t=0; t<ntris; t++) misses += cache.touch_triangle(&indices[t*3]);
+    return (float)misses/ntris;
+}
+
+float estimate_overdraw(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices) {
+    const int grid = 256;
+    const size_t ntris = indices.size()/3;
+    if (vertices.empty() || !ntris) return 1.f;
+    Vec3f lo = vertices[0].pos, hi = vertices[0].pos;
+    for (size_t i=1; i<vertices.size(); i++) {
+        for (int k=0; k<3; k++) {
+            lo[k] = std::min(lo[k], vertices[i].pos[k]);
+            hi[k] = std::max(hi[k], vertices[i].pos[k]);
+        }
+    }
+    float extent = std::max(hi.x-lo.x, std::max(hi.y-lo.y, hi.z-lo.z));
+    float scale = extent>0 ? (grid-1)/extent : 0.f;
+
+    std::vector<float> zbuffer(grid*grid);
+    long long shaded = 0, covered = 0;
+    for (int axis=0; axis<3; axis++) {
+        int ua = (axis+1)%3, va = (axis+2)%3;
+        for (int dir=-1; dir<=1; dir+=2) {
+            std::fill(zbuffer.begin(), zbuffer.end(), std::numeric_limits<float>::max());
+            for (size_t t=0; t<ntris; t++) {
+                Vec3f p[3];
+                for (int k=0; k<3; k++) {
+                    const Vec3f &v = vertices[indices[t*3+k]].pos;
+                    p[k] = Vec3f((v[ua]-lo[ua])*scale, (v[va]-lo[va])*scale, dir*v[axis]);
+                }
+                float area = (p[1].x-p[0].x)*(p[2].y-p[0].y) - (p[2].x-p[0].x)*(p[1].y-p[0].y);
+                if (area*dir<=0) continue; // back-facing or degenerate from this side
+                int x0 = std::max(0, (int)std::min(p[0].x, std::min(p[1].x, p[2].x)));
+                int y0 = std::max(0, (int)std::min(p[0].y, std::min(p[1].y, p[2].y)));
+                int x1 = std::min(grid-1, (int)std::max(p[0].x, std::max(p[1].x, p[2].x)));
+                int y1 = std::min(grid-1, (int)std::max(p[0].y, std::max(p[1].y, p[2].y)));
+                for (int y=y0; y<=y1; y++) {
+                    for (int x=x0; x<=x1; x++) {
+                        float px = x+.5f, py = y+.5f;
+                        float w0 = ((p[1].x-px)*(p[2].y-py) - (p[2].x-px)*(p[1].y-py))/area;
+                        float w1 = ((p[2].x-px)*(p[0].y-py) - (p[0].x-px)*(p[2].y-py))/area;
+                        float w2 = 1.f-w0-w1;
+                        if (w0<0 || w1<0 || w2<0) continue;
+                        float z = w0*p[0].z + w1*p[1].z + w2*p[2].z;
+                        float &depth = zbuffer[y*grid+x];
+                        if (z<depth) {
+                            depth = z;
+                            shaded++;
+                        }
+                    }
+                }
+            }
+            for (size_t i=0; i<zbuffer.size(); i++) covered += zbuffer[i]<std::numeric_limits<float>::max();
+        }
+    }
+    return covered ? (float)shaded/covered : 1.f;
+}
+
+void optimize_vertex_cache(std::vector<int> &indices, size_t nvertices, int cache_size) {
+    std::vector<int> order;
+    std::vector<size_t> hard;
+    tipsify(indices, nvertices, cache_size, order, hard);
+    apply_triangle_order(indices, order);
+}
+
+void optimize_triangle_order(ObjData &obj, int cache_size, float overdraw_threshold) {
+    const size_t ntris = obj.indices.size()/3;
+    if (!ntris) return;
+    std::vector<int> order;
+    std::vector<size_t> hard, clusters;
+    tipsify(obj.indices, obj.vertices.size(), cache_size, order, hard);
+    std::vector<int> tipsified(obj.indices);
+    apply_triangle_order(tipsified, order);
+    soft_boundaries(tipsified, obj.vertices.size(), hard, cache_size, overdraw_threshold, clusters);
+
+    // area-weighted centroid and normal of every cluster, relative to the mesh centroid
+    Vec3f mesh_centroid;
+    for (size_t i=0; i<obj.indices.size(); i++) mesh_centroid = mesh_centroid + obj.vertices[obj.indices[i]].pos;
+    mesh_centroid = mesh_centroid*(1.f/obj.indices.size());
+    std::vector<std::pair<float,int> > keys(clusters.size());
+    for (size_t c=0; c<clusters.size(); c++) {
+        size_t end = c+1<clusters.size() ? clusters[c+1] : ntris;
+        Vec3f centroid, normal;
+        float area = 0.f;
+        for (size_t t=clusters[c]; t<end; t++) {
+            const Vec3f &a = obj.vertices[tipsified[t*3]].pos;
+            const Vec3f &b = obj.vertices[tipsified[t*3+1]].pos;
+            const Vec3f &d = obj.vertices[tipsified[t*3+2]].pos;
+            Vec3f n = (b-a).cross(d-a);
+            float len = n.norm();
+            centroid = centroid + (a+b+d)*(len/3.f);
+            normal = normal + n;
+            area += len;
+        }
+        float key = 0.f;
+        if (area>0 && normal.norm()>0) key = (centroid*(1.f/area) - mesh_centroid)*normal.normalize();
+        keys[c] = std::make_pair(-key, (int)c); // outermost first
+    }
+    std::stable_sort(keys.begin(), keys.end());
+
+    std::vector<int> final_order;
+    final_order.reserve(ntris);
+    for (size_t i=0; i<keys.size(); i++) {
+        size_t c = keys[i].second;
+        size_t end = c+1<clusters.size() ? clusters[c+1] : ntris;
+        for (size_t t=clusters[c]; t<end; t++) final_order.push_back(order[t]);
+    }
+    apply_triangle_order(obj.indices, final_order);
+    apply_triangle_order(obj.vidx, final_order);
+    apply_triangle_order(obj.tidx, final_order);
+    apply_triangle_order(obj.nidx, final_order);
+}
+
+void compute_tangents(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, std::vector<Vec3f> &tangents, std::vector<Vec3f> &bitangents) {
+    const size_t nverts = vertices.size();
+    std::vector<Vec3f> sdir(nverts), tdir(nverts);
+    for (size_t t=0; t+2<indices.size(); t+=3) {
+        const MeshVertex &a = vertices[indices[t]], &b = vertices[indices[t+1]], &c = vertices[indices[t+2]];
+        Vec3f e1 = b.pos-a.pos, e2 = c.pos-a.pos;
+        Vec2f d1 = b.uv-a.uv, d2 = c.uv-a.uv;
+        float r = d1.x*d2.y - d2.x*d1.y;
+        if (std::fabs(r)<1e-12f) continue; // no uv area, no direction to follow
+        Vec3f s = (e1*d2.y - e2*d1.y)*(1.f/r);
+        Vec3f u = (e2*d1.x - e1*d2.x)*(1.f/r);
+        for (int k=0; k<3; k++) {
+            sdir[indices[t+k]] = sdir[indices[t+k]] + s;
+            tdir[indices[t+k]] = tdir[indices[t+k]] + u;
+        }
+    }
+    tangents.resize(nverts);
+    bitangents.resize(nverts);
+    for (size_t i=0; i<nverts; i++) {
+        Vec3f n = vertices[i].normal;
+        if (n.norm()<=0) n = Vec3f(0, 0, 1);
+        else n.normalize();
+        // Gram-Schmidt against the normal, any perpendicular when the uvs gave nothing usable
+        Vec3f t = sdir[i] - n*(n*sdir[i]);
+        if (t.norm()<1e-12f) t = std::fabs(n.x)<.9f ? Vec3f(1, 0, 0).cross(n) : Vec3f(0, 1, 0).cross(n);
+        t.normalize();
+        Vec3f b = n.cross(t);
+        tangents[i] = t;
+        bitangents[i] = b*tdir[i] < 0 ? b*-1.f : b;
+    }
+}
@@ -0,0 +1,33 @@
+#ifndef __MESHOPT_H__
+#define __MESHOPT_H__
+
+#include "objparser.h"
+
+// Merges corners that share the same (v, vt, vn) triple into obj.vertices and rewrites the
+// triangles as a single index buffer in obj.indices. Every corner needs valid v, vt and vn indices,
+// as parse_obj() guarantees.
+// Returns the vertex reuse ratio, corners per unique vertex.
+float weld_vertices(ObjData &obj);
+
+// Average cache miss ratio: vertex shader invocations per triangle with a FIFO post-transform
+// cache of cache_size entries. 0.5 is the ideal for large regular meshes, 3 means no reuse.
+float compute_acmr(const std::vector<int> &indices, size_t nvertices, int cache_size = 16);
+
+// Shaded fragments per covered pixel, averaged over six axis-aligned orthographic views of the
+// welded mesh with back-face culling and a strict depth test; 1 means no overdraw.
+float estimate_overdraw(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices);
+
+// Reorders the triangles of a welded mesh for the post-transform cache (Tipsify), then splits the
+// result into clusters wherever that costs at most overdraw_threshold times the cluster ACMR and
+// sorts the clusters so outward-facing ones on the outside of the mesh are drawn first.
+// The same permutation is applied to vidx/tidx/nidx so face(i) keeps matching indices.
+void optimize_triangle_order(ObjData &obj, int cache_size = 16, float overdraw_threshold = 1.05f);
+
+// Tipsify alone, for index buffers that only need cache locality
+void optimize_vertex_cache(std::vector<int> &indices, size_t nvertices, int cache_size = 16);
+
+// Per-vertex tangent frames from the uv layout (Lengyel): tangents follow +u, bitangents +v,
+// both orthonormal to the vertex normal; mirrored uv islands get a flipped bitangent.
+void compute_tangents(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, std::vector<Vec3f> &tangents, std::vector<Vec3f> &bitangents);
+
+#endif //__MESHOPT_H__
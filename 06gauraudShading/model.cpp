@@ -1,128 +1,314 @@
 #include <iostream>
-#include <string>
 #include <fstream>
-#include <sstream>
+#include <string>
 #include <vector>
 #include "model.h"
+#include "objparser.h"
+#include "meshcache.h"
+#include "meshopt.h"
+#include "simplify.h"
+#include "assetcache.h"
+#include "threadpool.h"
 
-Model::Model(const char *filename) : verts_(), faces_() {
-    std::ifstream in;
-    in.open (filename, std::ifstream::in);
-    if (in.fail()) return;
-    std::string line;
-    while (!in.eof()) {
-        std::getline(in, line);
-        std::istringstream iss(line.c_str());
-        char trash;
-        if (!line.compare(0, 2, "v ")) {
-            iss >> trash;
-            Vec3f v;
-            for (int i=0;i<3;i++) iss >> v[i];
-            verts_.push_back(v);
-        } else if (!line.compare(0, 2, "f ")) {
-            std::vector<int> f;
-            std::vector<int> t;
-            std::vector<int> n;
-            int idx, vtIdx, vnIdx;
-            iss >> trash; // 'f'
-            while (iss >> idx >> trash >> vtIdx >> trash >> vnIdx) {
-                // Wavefront OBJ indices are 1-based
-                idx   -= 1;
-                vtIdx -= 1;
-                vnIdx -= 1;
-                f.push_back(idx);
-                t.push_back(vtIdx);
-                n.push_back(vnIdx);
-            }
-            faces_.push_back(f);
-            texIndices_.push_back(t);
-            normIndices_.push_back(n);
-
-        } else if(!line.compare(0, 3, "vt ")) {
-            Vec2f texture;
-            char trash;
-            iss >> trash >> trash;
-            for (int i=0; i < 2; i++) iss >> texture[i];
-            // std::cout << texture << std::endl;
-
-            if (texture[1] == 0.) throw std::runtime_error("wrong read texture");
-            tex_coords_.push_back(texture);
-        } else if (!line.compare(0, 3, "vn ")) {
-            // parse vertex normal
-            iss >> trash >> trash; // read 'v' 'n'
-            Vec3f n;
-            for (int i = 0; i < 3; i++) iss >> n[i];
-            norms_.push_back(n);
-        }
+ModelBuilder::ModelBuilder() : model_(new Model()), bake_tangent_space_(false) {
+}
+
+ModelBuilder &ModelBuilder::bake_tangent_space(bool bake) {
+    bake_tangent_space_ = bake;
+    return *this;
+}
+
+ModelHandle ModelBuilder::build() {
+    ModelHandle model(model_.release());
+    model_.reset(new Model());
+    return model;
+}
+
+bool ModelBuilder::load(const char *filename) {
+    if (!load_geometry(filename)) return false;
+    model_->diffusemap_  = load_map(filename, "_diffuse.tga");
+    model_->specularmap_ = load_map(filename, "_spec.tga");
+    NormalMap nm = decode_map(load_map(filename, normal_map_suffix(bake_tangent_space_)));
+    attach_normal_map(nm);
+    return true;
+}
+
+std::future<ModelHandle> ModelBuilder::load_async(const std::string &filename, bool bake_tangent_space) {
+    ThreadPool &pool = ThreadPool::global();
+    std::shared_ptr<ModelBuilder> builder = std::make_shared<ModelBuilder>();
+    builder->bake_tangent_space(bake_tangent_space);
+    std::shared_future<bool> geometry = pool.submit([builder, filename]() { return builder->load_geometry(filename.c_str()); }).share();
+    std::shared_future<TextureHandle> diffuse = pool.submit([filename]() { return load_map(filename, "_diffuse.tga"); }).share();
+    std::shared_future<TextureHandle> specular = pool.submit([filename]() { return load_map(filename, "_spec.tga"); }).share();
+    std::shared_future<NormalMap> normals = pool.submit([filename, bake_tangent_space]() {
+        return decode_map(load_map(filename, normal_map_suffix(bake_tangent_space)));
+    }).share();
+    // assembled by whoever waits first, so no pool thread ever blocks on another task
+    return std::async(std::launch::deferred, [builder, geometry, diffuse, specular, normals]() {
+        if (!geometry.get()) return ModelHandle();
+        builder->model_->diffusemap_  = diffuse.get();
+        builder->model_->specularmap_ = specular.get();
+        NormalMap nm = normals.get();
+        builder->attach_normal_map(nm);
+        return builder->build();
+    });
+}
+
+std::vector<std::string> ModelBuilder::sibling_files(const std::string &filename, bool bake_tangent_space) {
+    std::vector<std::string> files;
+    const char *suffixes[] = {"_diffuse.tga", "_spec.tga", normal_map_suffix(bake_tangent_space), "_skin.txt"};
+    for (int i=0; i<4; i++) {
+        std::string file = sibling(filename, suffixes[i]);
+        if (!file.empty()) files.push_back(file);
     }
-    std::cerr << "# v# " << verts_.size() << " f# "  << faces_.size() << " vt#" << tex_coords_.size() << std::endl;
+    return files;
+}
+
+// <name><suffix> for <name>.<ext>, empty without an extension
+std::string ModelBuilder::sibling(const std::string &filename, const char *suffix) {
+    size_t dot = filename.find_last_of(".");
+    if (dot == std::string::npos) return std::string();
+    return filename.substr(0, dot) + suffix;
+}
+
+const char *ModelBuilder::normal_map_suffix(bool tangent_space) {
+    return tangent_space ? "_nm_tangent.tga" : "_nm.tga";
+}
+
+NormalMap ModelBuilder::decode_map(const TextureHandle &tex) {
+    NormalMap map;
+    if (tex) decode_normal_map(tex->view(), map);
+    return map;
+}
+
+// the tangent frames come from the geometry, so baking waits for it
+void ModelBuilder::attach_normal_map(NormalMap &map) {
+    Model &m = *model_;
+    std::swap(m.normalmap_, map);
+    if (bake_tangent_space_) bake_object_space(m.normalmap_, m.vertices_, m.indices_, m.tangents_, m.bitangents_);
+}
+
+bool ModelBuilder::load_geometry(const char *filename) {
+    model_.reset(new Model());
+    Model &m = *model_;
+    ObjData obj;
+    if (!load_mesh_cache(filename, obj)) {
+        if (!parse_obj(filename, obj)) return false;
+        weld_vertices(obj);
+        float acmr = compute_acmr(obj.indices, obj.vertices.size());
+        float overdraw = estimate_overdraw(obj.vertices, obj.indices);
+        optimize_triangle_order(obj);
+        std::cerr << "# ACMR " << acmr << " -> " << compute_acmr(obj.indices, obj.vertices.size())
+                  << ", overdraw " << overdraw << " -> " << estimate_overdraw(obj.vertices, obj.indices) << std::endl;
+        static const float lod_ratios[] = {.5f, .25f, .12f};
+        build_lod_chain(obj.vertices, obj.indices, lod_ratios, 3, obj.lods);
+        save_mesh_cache(filename, obj);
+    }
+    m.bbox_min_ = obj.bbox_min;
+    m.bbox_max_ = obj.bbox_max;
+    m.verts_.swap(obj.verts);
+    m.tex_coords_.swap(obj.uvs);
+    m.norms_.swap(obj.norms);
+    m.faces_.swap(obj.vidx);
+    m.tex_idx_.swap(obj.tidx);
+    m.norm_idx_.swap(obj.nidx);
+    m.vertices_.swap(obj.vertices);
+    m.indices_.swap(obj.indices);
+    m.lods_.swap(obj.lods);
+    build_meshlets(m.vertices_, m.indices_, m.meshlets_);
+    // normals are unit length from here on, shading code never renormalises them
+    for (size_t i=0; i<m.norms_.size(); i++) {
+        Vec3f n = m.norms_[i];
+        if (n.norm()>0) m.norms_.set(i, n.normalize());
+    }
+    for (size_t i=0; i<m.vertices_.size(); i++) {
+        if (m.vertices_[i].normal.norm()>0) m.vertices_[i].normal.normalize();
+    }
+    compute_tangents(m.vertices_, m.indices_, m.tangents_, m.bitangents_);
+    load_skin(filename);
+    std::cerr << "# v# " << m.verts_.size() << " f# "  << m.nfaces() << " vt#" << m.tex_coords_.size() << std::endl;
+    if (!m.vertices_.empty())
+        std::cerr << "# welded " << m.vertices_.size() << " vertices, reuse " << (float)m.indices_.size()/m.vertices_.size()
+                  << ", " << m.meshlets_.size() << " meshlets" << std::endl;
+    for (size_t i=0; i<m.lods_.size(); i++)
+        std::cerr << "# LOD" << i+1 << " f# " << m.lods_[i].indices.size()/3 << " error " << m.lods_[i].error << std::endl;
+    return true;
+}
+
+// influences per OBJ position from <name>_skin.txt, spread over the welded vertices
+void ModelBuilder::load_skin(const std::string &filename) {
+    std::string skinfile = sibling(filename, "_skin.txt");
+    if (skinfile.empty() || !std::ifstream(skinfile.c_str())) return;
+    Model &m = *model_;
+    std::vector<int> joints[SKIN_MAX_INFLUENCES];
+    std::vector<float> weights[SKIN_MAX_INFLUENCES];
+    bool ok = load_skin_weights(skinfile.c_str(), (int)m.verts_.size(), joints, weights);
+    if (ok) build_skin(m.vertices_, m.indices_, m.faces_, joints, weights, m.skin_);
+    std::cerr << "skin file " << skinfile << " loading " << (ok ? "ok" : "failed") << std::endl;
+}
+
+Model::Model() {
+}
+
+Model::Model(const char *filename, bool bake_tangent_space) {
+    ModelBuilder builder;
+    builder.bake_tangent_space(bake_tangent_space).load(filename);
+    swap(*builder.model_);
 }
 
 Model::~Model() {
 }
 
-int Model::nverts() {
+void Model::swap(Model &o) {
+    verts_.swap(o.verts_);
+    tex_coords_.swap(o.tex_coords_);
+    norms_.swap(o.norms_);
+    faces_.swap(o.faces_);
+    tex_idx_.swap(o.tex_idx_);
+    norm_idx_.swap(o.norm_idx_);
+    vertices_.swap(o.vertices_);
+    indices_.swap(o.indices_);
+    meshlets_.swap(o.meshlets_);
+    lods_.swap(o.lods_);
+    tangents_.swap(o.tangents_);
+    bitangents_.swap(o.bitangents_);
+    std::swap(skin_, o.skin_);
+    std::swap(normalmap_, o.normalmap_);
+    diffusemap_.swap(o.diffusemap_);
+    specularmap_.swap(o.specularmap_);
+    std::swap(bbox_min_, o.bbox_min_);
+    std::swap(bbox_max_, o.bbox_max_);
+}
+
+int Model::nverts() const {
     return (int)verts_.size();
 }
 
-int Model::nfaces() {
-    return (int)faces_.size();
+int Model::nfaces() const {
+    return (int)faces_.size()/3;
 }
 
-std::vector<int> Model::face(int idx) {
-    return faces_[idx];
+const int *Model::face(int idx) const {
+    return &faces_[idx*3];
 }
 
-std::vector<int> Model::texIndices(int idx) {
-    return texIndices_[idx];
+const int *Model::texIndices(int idx) const {
+    return &tex_idx_[idx*3];
 }
 
-Vec3f Model::vert(int i) {
+const int *Model::normIndices(int idx) const {
+    return &norm_idx_[idx*3];
+}
+
+const Vec3fArray &Model::positions() const {
+    return verts_;
+}
+
+const std::vector<MeshVertex> &Model::vertices() const {
+    return vertices_;
+}
+
+const std::vector<int> &Model::indices() const {
+    return indices_;
+}
+
+const std::vector<Meshlet> &Model::meshlets() const {
+    return meshlets_;
+}
+
+const std::vector<MeshLod> &Model::lods() const {
+    return lods_;
+}
+
+const Skin &Model::skin() const {
+    return skin_;
+}
+
+Vec3f Model::bbox_min() const {
+    return bbox_min_;
+}
+
+Vec3f Model::bbox_max() const {
+    return bbox_max_;
+}
+
+Vec3f Model::vert(int i) const {
     return verts_[i];
 }
-Vec3f Model::vert(int iface, int nthvert) {
-    return verts_[faces_[iface][nthvert]];
+Vec3f Model::vert(int iface, int nthvert) const {
+    return verts_[faces_[iface*3+nthvert]];
 }
 
-Vec2f Model::texture(int i) {
+Vec2f Model::texture(int i) const {
     return tex_coords_[i];
 }
 
-void Model::load_texture(std::string filename, const char* suffix, TGAImage& image) {
-    std::string texfile(filename);
-    size_t dot = texfile.find_first_of(".");
-    if (dot != std::string::npos) {
-        texfile = texfile.substr(0, dot) + std::string(suffix);
-        std::cerr << "texture file " << texfile << " loading " << (image.read_tga_file(texfile.c_str()) ? "ok" : "failed") <<std::endl;
-        image.flip_vertically();
+TextureHandle ModelBuilder::load_map(const std::string &filename, const char* suffix) {
+    TextureHandle tex;
+    std::string texfile = sibling(filename, suffix);
+    if (!texfile.empty()) {
+        tex = AssetCache::global().texture(texfile);
+        std::cerr << "texture file " << texfile << " loading " << (tex ? "ok" : "failed") <<std::endl;
     }
+    return tex;
 }
 
-Vec3f Model::normal(Vec2f uvf) {
-    Vec2i uv(uvf[0] * normalmap_.get_width(), uvf[1] * normalmap_.get_height());
-    TGAColor c = normalmap_.get(uv[0], uv[1]);
-    Vec3f res;
-    for (int i=0; i<3; i++) {
-        res[2-i] = (float)c[i]/255.f*2.f - 1.f;
-    }
+// missing maps sample as an empty view
+static const ImageView &view_of(const TextureHandle &tex) {
+    static const ImageView empty;
+    return tex ? tex->view() : empty;
+}
+
+Vec3f Model::normal(Vec2f uvf) const {
+    return normalmap_.sample(uvf);
+}
+
+Vec3f Model::tangent(int iface, int nthvert) const {
+    return tangents_[indices_[iface*3+nthvert]];
+}
 
-    return res;
+Vec3f Model::bitangent(int iface, int nthvert) const {
+    return bitangents_[indices_[iface*3+nthvert]];
 }
 
-Vec2f Model::uv(int iface, int nthvert) {
-    return uv_[faces_[iface][nthvert]];
+Vec2f Model::uv(int iface, int nthvert) const {
+    return tex_coords_[tex_idx_[iface*3+nthvert]];
 }
 
-float Model::specular(Vec2f uvf) {
-    Vec2i uv(uvf[0] * specularmap_.get_width(), uvf[1] * specularmap_.get_height());
-    return specularmap_.get(uv[0], uv[1])[0] /1.f;
+float Model::specular(Vec2f uvf) const {
+    const ImageView &map = view_of(specularmap_);
+    Vec2i uv(uvf[0] * map.width, uvf[1] * map.height);
+    return map.get(uv[0], uv[1])[0] /1.f;
 }
 
-Vec3f Model::normal(int iface, int nthvert) {
-    int normal_index = normIndices_[iface][nthvert];
-    // Make sure normal_index is in range
-    return norms_[normal_index].normalize();
+TGAColor Model::diffuse(Vec2f uvf) const {
+    const ImageView &map = view_of(diffusemap_);
+    Vec2i uv(uvf[0] * map.width, uvf[1] * map.height);
+    return map.get(uv[0], uv[1]);
+}
+
+const ImageView &Model::diffusemap() const {
+    return view_of(diffusemap_);
+}
+
+Vec3f Model::normal(int iface, int nthvert) const {
+    return norms_[norm_idx_[iface*3+nthvert]];
 }
 
 
 
+
+template <typename T> static size_t bytes_of(const std::vector<T> &v) {
+    return v.capacity()*sizeof(T);
+}
+
+size_t Model::size_bytes() const {
+    size_t bytes = sizeof(Model);
+    for (int k=0; k<3; k++) bytes += bytes_of(verts_.c[k]) + bytes_of(norms_.c[k]);
+    for (int k=0; k<2; k++) bytes += bytes_of(tex_coords_.c[k]);
+    bytes += bytes_of(faces_) + bytes_of(tex_idx_) + bytes_of(norm_idx_) + bytes_of(vertices_) + bytes_of(indices_);
+    bytes += bytes_of(meshlets_) + bytes_of(tangents_) + bytes_of(bitangents_) + bytes_of(normalmap_.texels);
+    for (size_t i=0; i<lods_.size(); i++) bytes += bytes_of(lods_[i].indices);
+    bytes += skin_.size_bytes();
+    return bytes;
+}
@@ -2,45 +2,123 @@
 #define __MODEL_H__
 
 #include <vector>
+#include <memory>
+#include <future>
+#include <string>
 #include "geometry.h"
 #include "tgaimage.h"
+#include "texture.h"
+#include "objparser.h"
+#include "meshlet.h"
+#include "normalmap.h"
+#include "skinning.h"
 
+// Immutable mesh and texture asset: every accessor is const and nothing is cached lazily,
+// so any number of render threads may read one Model concurrently. ModelBuilder creates them.
 class Model {
+	friend class ModelBuilder;
 private:
-	std::vector<Vec3f> verts_;
-	std::vector<std::vector<int> > faces_;
-	std::vector<std::vector<int>> texIndices_;
-	std::vector<Vec2f> tex_coords_;
+	Vec3fArray verts_;
+	Vec2fArray tex_coords_;
+	Vec3fArray norms_;
+	// three indices per triangle into the arrays above; corners the OBJ gave no uv or normal
+	// refer to ones generated at load, see parse_obj()
+	std::vector<int> faces_;
+	std::vector<int> tex_idx_;
+	std::vector<int> norm_idx_;
+	// welded (v, vt, vn) vertices with a single index per corner
+	std::vector<MeshVertex> vertices_;
+	std::vector<int> indices_;
+	std::vector<Meshlet> meshlets_;
+	std::vector<MeshLod> lods_;
+	// per welded vertex, orthonormal to the vertex normal
+	std::vector<Vec3f> tangents_;
+	std::vector<Vec3f> bitangents_;
+	// empty unless <name>_skin.txt was found
+	Skin skin_;
 
-	TGAImage normalmap_;
-	TGAImage diffusemap_;
-	TGAImage specularmap_;
+	NormalMap normalmap_;
+	TextureHandle diffusemap_;
+	TextureHandle specularmap_;
 
-	std::vector<Vec3f> norms_;
-	std::vector<Vec2f> uv_;
-	void load_texture(std::string filename, const char* suffix, TGAImage &img);
+	Vec3f bbox_min_;
+	Vec3f bbox_max_;
+
+	Model();
+	Model(const Model &);
+	Model & operator =(const Model &);
+	void swap(Model &other);
 
 public:
-	Model(const char *filename);
+	// shorthand for ModelBuilder().bake_tangent_space(bake).load(filename); empty if that fails
+	Model(const char *filename, bool bake_tangent_space = false);
 	~Model();
-	int nverts();
-	int nfaces();
-	Vec3f vert(int i);
-	std::vector<int> face(int idx);
-	std::vector<int> texIndices(int idx);
-
-	// std::vector<Vec3f> norms_;
-	std::vector<std::vector<int>> normIndices_;
+	int nverts() const;
+	int nfaces() const;
+	Vec3f vert(int i) const;
+	Vec3f bbox_min() const;
+	Vec3f bbox_max() const;
+	// the three corners of a triangle, pointing into the flat index buffers
+	const int *face(int idx) const;
+	const int *texIndices(int idx) const;
+	const int *normIndices(int idx) const;
+	const Vec3fArray &positions() const;
+	const std::vector<MeshVertex> &vertices() const;
+	const std::vector<int> &indices() const;
+	// clusters of consecutive triangles in indices(), for culling before any vertex work
+	const std::vector<Meshlet> &meshlets() const;
+	// simplified index buffers over vertices(), finest first
+	const std::vector<MeshLod> &lods() const;
+	// joint influences of vertices(), input of skin_vertices()
+	const Skin &skin() const;
 
-	Vec2f texture(int idx);
+	Vec2f texture(int idx) const;
 	// Vec2f normal(Vec2f vert);
-	Vec3f normal(int iface, int nthvert);
-	Vec3f normal(Vec2f uv);
-	Vec3f vert(int iface, int nthvert);
-	Vec2f uv(int iface, int nthvert);
-	TGAColor diffuse(Vec2f uv);
-	float specular(Vec2f uv);
+	Vec3f normal(int iface, int nthvert) const;
+	Vec3f normal(Vec2f uv) const;
+	Vec3f tangent(int iface, int nthvert) const;
+	Vec3f bitangent(int iface, int nthvert) const;
+	Vec3f vert(int iface, int nthvert) const;
+	Vec2f uv(int iface, int nthvert) const;
+	TGAColor diffuse(Vec2f uv) const;
+	float specular(Vec2f uv) const;
+	const ImageView &diffusemap() const;
+	// geometry and decoded normal map; shared textures are accounted for where they are cached
+	size_t size_bytes() const;
+
+};
 
+typedef std::shared_ptr<const Model> ModelHandle;
+
+// The mutable side of Model. load() reads the mesh (through the mesh cache), derives what the
+// renderer needs and loads the maps; build() hands the result over as an immutable Model.
+class ModelBuilder {
+	friend class Model;
+private:
+	std::unique_ptr<Model> model_;
+	bool bake_tangent_space_;
+
+	bool load_geometry(const char *filename);
+	void load_skin(const std::string &filename);
+	void attach_normal_map(NormalMap &map);
+	static std::string sibling(const std::string &filename, const char *suffix);
+	static TextureHandle load_map(const std::string &filename, const char* suffix);
+	static NormalMap decode_map(const TextureHandle &tex);
+	static const char *normal_map_suffix(bool tangent_space);
+public:
+	ModelBuilder();
+	// load <name>_nm_tangent.tga instead of <name>_nm.tga and convert it to object space once,
+	// so normal(uv) needs no per-pixel tangent frame
+	ModelBuilder &bake_tangent_space(bool bake);
+	bool load(const char *filename);
+	// Geometry and the three maps load as separate tasks on ThreadPool::global(), so disk reads
+	// and decoding overlap; the model is assembled by the first get(). An empty handle means the
+	// mesh could not be read. Don't wait on it from a pool task, the parts may be queued behind it.
+	static std::future<ModelHandle> load_async(const std::string &filename, bool bake_tangent_space = false);
+	// the maps and skin file next to filename that a load reads, whether they exist or not
+	static std::vector<std::string> sibling_files(const std::string &filename, bool bake_tangent_space = false);
+	// the builder starts over empty afterwards
+	ModelHandle build();
 };
 
 #endif //__MODEL_H__
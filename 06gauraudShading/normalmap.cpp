@@ -0,0 +1,54 @@
+#include <algorithm>
+#include "normalmap.h"
+
+void decode_normal_map(const ImageView &view, NormalMap &out) {
+    out.width = view.width;
+    out.height = view.height;
+    out.texels.resize((size_t)view.width*view.height);
+    if (view.bytespp<3) {
+        out.texels.clear();
+        out.width = out.height = 0;
+        return;
+    }
+    for (int y=0; y<view.height; y++) {
+        for (int x=0; x<view.width; x++) {
+            const unsigned char *p = view.pixel(x, y); // bgr
+            Vec3f n(p[2]/255.f*2.f - 1.f, p[1]/255.f*2.f - 1.f, p[0]/255.f*2.f - 1.f);
+            if (n.norm()>0) n.normalize();
+            out.texels[x+y*view.width] = n;
+        }
+    }
+}
+
+void bake_object_space(NormalMap &map, const std::vector<MeshVertex> &vertices, const std::vector<int> &indices,
+                       const std::vector<Vec3f> &tangents, const std::vector<Vec3f> &bitangents) {
+    if (map.empty()) return;
+    std::vector<Vec3f> baked(map.texels);
+    for (size_t t=0; t+2<indices.size(); t+=3) {
+        const int *tri = &indices[t];
+        Vec2f p[3];
+        for (int k=0; k<3; k++) p[k] = Vec2f(vertices[tri[k]].uv.x*map.width, vertices[tri[k]].uv.y*map.height);
+        float area = (p[1].x-p[0].x)*(p[2].y-p[0].y) - (p[2].x-p[0].x)*(p[1].y-p[0].y);
+        if (area==0) continue;
+        int x0 = std::max(0, (int)std::min(p[0].x, std::min(p[1].x, p[2].x)));
+        int y0 = std::max(0, (int)std::min(p[0].y, std::min(p[1].y, p[2].y)));
+        int x1 = std::min(map.width-1, (int)std::max(p[0].x, std::max(p[1].x, p[2].x)));
+        int y1 = std::min(map.height-1, (int)std::max(p[0].y, std::max(p[1].y, p[2].y)));
+        for (int y=y0; y<=y1; y++) {
+            for (int x=x0; x<=x1; x++) {
+                float px = x+.5f, py = y+.5f;
+                float w0 = ((p[1].x-px)*(p[2].y-py) - (p[2].x-px)*(p[1].y-py))/area;
+                float w1 = ((p[2].x-px)*(p[0].y-py) - (p[0].x-px)*(p[2].y-py))/area;
+                float w2 = 1.f-w0-w1;
+                if (w0<0 || w1<0 || w2<0) continue;
+                Vec3f n = vertices[tri[0]].normal*w0 + vertices[tri[1]].normal*w1 + vertices[tri[2]].normal*w2;
+                Vec3f tg = tangents[tri[0]]*w0 + tangents[tri[1]]*w1 + tangents[tri[2]]*w2;
+                Vec3f bt = bitangents[tri[0]]*w0 + bitangents[tri[1]]*w1 + bitangents[tri[2]]*w2;
+                const Vec3f &ts = map.texels[x+y*map.width];
+                Vec3f o = tg*ts.x + bt*ts.y + n*ts.z;
+                if (o.norm()>0) baked[x+y*map.width] = o.normalize();
+            }
+        }
+    }
+    map.texels.swap(baked);
+}
@@ -0,0 +1,35 @@
+#ifndef __NORMALMAP_H__
+#define __NORMALMAP_H__
+
+#include <vector>
+#include <algorithm>
+#include "geometry.h"
+#include "tgaimage.h"
+#include "objparser.h"
+
+// Normal map decoded once into unit vectors, laid out like the texture view it came from
+// (uv (0,0) is texel 0). Channels map r,g,b to x,y,z.
+struct NormalMap {
+    int width;
+    int height;
+    std::vector<Vec3f> texels;
+
+    NormalMap() : width(0), height(0) {}
+    bool empty() const { return texels.empty(); }
+    // nearest texel, clamped to the edges; a zero vector when there is no map
+    Vec3f sample(Vec2f uv) const {
+        if (texels.empty()) return Vec3f();
+        int x = std::min(width-1, std::max(0, (int)(uv.x*width)));
+        int y = std::min(height-1, std::max(0, (int)(uv.y*height)));
+        return texels[x+y*width];
+    }
+};
+
+void decode_normal_map(const ImageView &view, NormalMap &out);
+
+// Turns a tangent-space map into an object-space one: every triangle is rasterised in uv space and
+// the texels it covers are rotated by the interpolated tangent frame. Uncovered texels keep their value.
+void bake_object_space(NormalMap &map, const std::vector<MeshVertex> &vertices, const std::vector<int> &indices,
+                       const std::vector<Vec3f> &tangents, const std::vector<Vec3f> &bitangents);
+
+#endif //__NORMALMAP_H__
@@ -0,0 +1,265 @@
+#include <iostream>
+#include <algorithm>
+#include "objparser.h"
+#include "mappedfile.h"
+#include "threadpool.h"
+
+namespace {
+
+struct Chunk {
+    ObjData data;
+    // positions in data.vidx/tidx/nidx holding relative indices; they are local to the chunk
+    // until the merge adds the number of elements that came before it
+    std::vector<size_t> vrel, trel, nrel;
+};
+
+inline bool is_blank(char c) {
+    return c==' ' || c=='\t' || c=='\r';
+}
+
+inline const char *skip_blanks(const char *p, const char *end) {
+    while (p<end && is_blank(*p)) p++;
+    return p;
+}
+
+// from_chars-style float parsing: no locale, no allocation, no stream state
+const char *parse_float(const char *p, const char *end, float &value) {
+    static const double pow10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18};
+    p = skip_blanks(p, end);
+    bool negative = false;
+    if (p<end && (*p=='-' || *p=='+')) negative = (*p++=='-');
+    unsigned long long mantissa = 0;
+    int digits = 0, exponent = 0;
+    for (; p<end && *p>='0' && *p<='9'; p++) {
+        if (digits<18) { mantissa = mantissa*10 + (*p-'0'); if (mantissa) digits++; }
+        else exponent++;
+    }
+    if (p<end && *p=='.') {
+        for (p++; p<end && *p>='0' && *p<='9'; p++) {
+            if (digits<18) { mantissa = mantissa*10 + (*p-'0'); if (mantissa) digits++; exponent--; }
+        }
+    }
+    if (p<end && (*p=='e' || *p=='E')) {
+        const char *q = p+1;
+        bool eneg = false;
+        if (q<end && (*q=='-' || *q=='+')) eneg = (*q++=='-');
+        if (q<end && *q>='0' && *q<='9') {
+            int e = 0;
+            for (; q<end && *q>='0' && *q<='9'; q++) e = std::min(e*10 + (*q-'0'), 1000);
+            exponent += eneg ? -e : e;
+            p = q;
+        }
+    }
+    double v = (double)mantissa;
+    while (exponent>18)  { v *= 1e18; exponent -= 18; }
+    while (exponent<-18) { v /= 1e18; exponent += 18; }
+    v = exponent<0 ? v/pow10[-exponent] : v*pow10[exponent];
+    value = (float)(negative ? -v : v);
+    return p;
+}
+
+inline const char *parse_int(const char *p, const char *end, int &value, bool &ok) {
+    bool negative = false;
+    if (p<end && (*p=='-' || *p=='+')) negative = (*p++=='-');
+    const char *start = p;
+    int v = 0;
+    for (; p<end && *p>='0' && *p<='9'; p++) v = v*10 + (*p-'0');
+    ok = (p!=start);
+    value = negative ? -v : v;
+    return p;
+}
+
+// One index of a face corner: 1-based absolute, or negative relative to the elements defined so far.
+inline void push_index(int idx, int count, std::vector<int> &indices, std::vector<size_t> &relative) {
+    if (idx<0) {
+        relative.push_back(indices.size());
+        indices.push_back(count+idx);
+    } else {
+        indices.push_back(idx-1);
+    }
+}
+
+// polygons are limited to 64 corners, extra corners are dropped
+void parse_face(const char *p, const char *end, Chunk &chunk) {
+    ObjData &d = chunk.data;
+    int corners[3][64];
+    bool has[3][64];
+    int n = 0;
+    while (n<64) {
+        p = skip_blanks(p, end);
+        if (p>=end || *p=='#') break;
+        bool ok;
+        int v = 0, t = 0, vn = 0;
+        p = parse_int(p, end, v, ok);
+        if (!ok) break;
+        has[1][n] = has[2][n] = false;
+        if (p<end && *p=='/') {
+            p++;
+            if (p<end && *p!='/') { p = parse_int(p, end, t, ok); has[1][n] = ok; }
+            if (p<end && *p=='/') { p++; p = parse_int(p, end, vn, ok); has[2][n] = ok; }
+        }
+        while (p<end && !is_blank(*p)) p++; // tolerate anything glued to the token
+        corners[0][n] = v; corners[1][n] = t; corners[2][n] = vn;
+        n++;
+    }
+    // fan triangulation: (0, i, i+1)
+    for (int i=1; i+1<n; i++) {
+        int c[3] = {0, i, i+1};
+        for (int k=0; k<3; k++) {
+            push_index(corners[0][c[k]], (int)d.verts.size(), d.vidx, chunk.vrel);
+            if (has[1][c[k]]) push_index(corners[1][c[k]], (int)d.uvs.size(), d.tidx, chunk.trel);
+            else d.tidx.push_back(-1);
+            if (has[2][c[k]]) push_index(corners[2][c[k]], (int)d.norms.size(), d.nidx, chunk.nrel);
+            else d.nidx.push_back(-1);
+        }
+    }
+}
+
+void parse_chunk(const char *p, const char *end, Chunk &chunk) {
+    ObjData &d = chunk.data;
+    while (p<end) {
+        const char *eol = std::find(p, end, '\n');
+        const char *q = skip_blanks(p, eol);
+        if (eol-q>=2 && q[0]=='v' && is_blank(q[1])) {
+            Vec3f v;
+            q = parse_float(q+2, eol, v.x);
+            q = parse_float(q, eol, v.y);
+            parse_float(q, eol, v.z);
+            d.verts.push_back(v);
+        } else if (eol-q>=3 && q[0]=='v' && q[1]=='t' && is_blank(q[2])) {
+            Vec2f t;
+            q = parse_float(q+3, eol, t.x);
+            parse_float(q, eol, t.y);
+            d.uvs.push_back(t);
+        } else if (eol-q>=3 && q[0]=='v' && q[1]=='n' && is_blank(q[2])) {
+            Vec3f n;
+            q = parse_float(q+3, eol, n.x);
+            q = parse_float(q, eol, n.y);
+            parse_float(q, eol, n.z);
+            d.norms.push_back(n);
+        } else if (eol-q>=2 && q[0]=='f' && is_blank(q[1])) {
+            parse_face(q+2, eol, chunk);
+        }
+        p = eol+1;
+    }
+}
+
+bool indices_in_range(const std::vector<int> &indices, size_t count, bool optional) {
+    for (size_t i=0; i<indices.size(); i++) {
+        if (optional && indices[i]==-1) continue;
+        if (indices[i]<0 || (size_t)indices[i]>=count) return false;
+    }
+    return true;
+}
+
+// Corners without a uv share one (0,0) coordinate. Corners without a normal get, per position, the
+// area-weighted average of the faces that lack one, so meshes without vn still shade smoothly.
+void fill_missing_attributes(ObjData &d) {
+    if (std::find(d.tidx.begin(), d.tidx.end(), -1)!=d.tidx.end()) {
+        int zero = (int)d.uvs.size();
+        d.uvs.push_back(Vec2f());
+        std::replace(d.tidx.begin(), d.tidx.end(), -1, zero);
+    }
+    if (std::find(d.nidx.begin(), d.nidx.end(), -1)==d.nidx.end()) return;
+    std::vector<Vec3f> sums(d.verts.size());
+    for (size_t t=0; t+2<d.nidx.size(); t+=3) {
+        if (d.nidx[t]!=-1 && d.nidx[t+1]!=-1 && d.nidx[t+2]!=-1) continue;
+        Vec3f a = d.verts[d.vidx[t]], b = d.verts[d.vidx[t+1]], c = d.verts[d.vidx[t+2]];
+        Vec3f n = (b-a).cross(c-a); // length is twice the area
+        for (int k=0; k<3; k++) sums[d.vidx[t+k]] = sums[d.vidx[t+k]] + n;
+    }
+    std::vector<int> generated(d.verts.size(), -1);
+    for (size_t i=0; i<d.nidx.size(); i++) {
+        if (d.nidx[i]!=-1) continue;
+        int &n = generated[d.vidx[i]];
+        if (n<0) {
+            n = (int)d.norms.size();
+            d.norms.push_back(sums[d.vidx[i]].normalize());
+        }
+        d.nidx[i] = n;
+    }
+}
+
+template <typename T> void append(std::vector<T> &dst, size_t offset, const std::vector<T> &src) {
+    std::copy(src.begin(), src.end(), dst.begin()+offset);
+}
+
+template <size_t DIM> void append(vec_array<DIM> &dst, size_t offset, const vec_array<DIM> &src) {
+    for (size_t k=0; k<DIM; k++) append(dst.c[k], offset, src.c[k]);
+}
+
+}
+
+void compute_bounds(ObjData &obj) {
+    if (obj.verts.empty()) {
+        obj.bbox_min = obj.bbox_max = Vec3f();
+        return;
+    }
+    for (int k=0; k<3; k++) {
+        const std::vector<float> &c = obj.verts.c[k];
+        obj.bbox_min[k] = *std::min_element(c.begin(), c.end());
+        obj.bbox_max[k] = *std::max_element(c.begin(), c.end());
+    }
+}
+
+bool parse_obj(const char *filename, ObjData &out) {
+    out = ObjData();
+    MappedFile file;
+    if (!file.open(filename)) return false;
+    const char *begin = (const char *)file.data();
+    const char *end = begin + file.size();
+
+    // chunks of at least 1MB, cut right after a newline
+    ThreadPool &pool = ThreadPool::global();
+    const size_t min_chunk = 1<<20;
+    size_t nchunks = std::max<size_t>(1, std::min<size_t>(4*pool.size(), file.size()/min_chunk));
+    std::vector<const char *> bounds(1, begin);
+    for (size_t i=1; i<nchunks; i++) {
+        const char *cut = std::max(bounds.back(), begin + file.size()*i/nchunks);
+        cut = std::find(cut, end, '\n');
+        bounds.push_back(cut<end ? cut+1 : end);
+    }
+    bounds.push_back(end);
+    nchunks = bounds.size()-1;
+
+    std::vector<Chunk> chunks(nchunks);
+    pool.parallel_for(0, (int)nchunks, [&](int i) {
+        parse_chunk(bounds[i], bounds[i+1], chunks[i]);
+    });
+
+    // element offsets of every chunk, then a parallel in-order copy with relative indices fixed up
+    std::vector<size_t> voff(nchunks+1, 0), toff(nchunks+1, 0), noff(nchunks+1, 0), ioff(nchunks+1, 0);
+    for (size_t i=0; i<nchunks; i++) {
+        voff[i+1] = voff[i] + chunks[i].data.verts.size();
+        toff[i+1] = toff[i] + chunks[i].data.uvs.size();
+        noff[i+1] = noff[i] + chunks[i].data.norms.size();
+        ioff[i+1] = ioff[i] + chunks[i].data.vidx.size();
+    }
+    out.verts.resize(voff[nchunks]);
+    out.uvs.resize(toff[nchunks]);
+    out.norms.resize(noff[nchunks]);
+    out.vidx.resize(ioff[nchunks]);
+    out.tidx.resize(ioff[nchunks]);
+    out.nidx.resize(ioff[nchunks]);
+    pool.parallel_for(0, (int)nchunks, [&](int i) {
+        Chunk &c = chunks[i];
+        for (size_t k=0; k<c.vrel.size(); k++) c.data.vidx[c.vrel[k]] += (int)voff[i];
+        for (size_t k=0; k<c.trel.size(); k++) c.data.tidx[c.trel[k]] += (int)toff[i];
+        for (size_t k=0; k<c.nrel.size(); k++) c.data.nidx[c.nrel[k]] += (int)noff[i];
+        append(out.verts, voff[i], c.data.verts);
+        append(out.uvs,   toff[i], c.data.uvs);
+        append(out.norms, noff[i], c.data.norms);
+        append(out.vidx,  ioff[i], c.data.vidx);
+        append(out.tidx,  ioff[i], c.data.tidx);
+        append(out.nidx,  ioff[i], c.data.nidx);
+    });
+    if (!indices_in_range(out.vidx, out.verts.size(), false) || !indices_in_range(out.tidx, out.uvs.size(), true) ||
+        !indices_in_range(out.nidx, out.norms.size(), true)) {
+        std::cerr << "face index out of range in " << filename << std::endl;
+        out = ObjData();
+        return false;
+    }
+    fill_missing_attributes(out);
+    compute_bounds(out);
+    return true;
+}
@@ -0,0 +1,48 @@
+#ifndef __OBJPARSER_H__
+#define __OBJPARSER_H__
+
+#include <vector>
+#include "geometry.h"
+
+// One unique (position, uv, normal) combination of the welded mesh, interleaved for the vertex stage.
+struct MeshVertex {
+    Vec3f pos;
+    Vec2f uv;
+    Vec3f normal;
+};
+
+// A simplified level of detail: triangles over the same welded vertices, and the largest
+// geometric deviation from the full mesh it introduced, in model units.
+struct MeshLod {
+    std::vector<int> indices;
+    float error;
+};
+
+// Triangulated contents of a Wavefront OBJ with 0-based indices, three per triangle.
+// Every index is valid: corners the file gave no uv or normal (f v, f v//vn, f v/vt) point to
+// attributes generated by parse_obj().
+// Attributes are stored as structure-of-arrays, ready to be moved into a Model.
+struct ObjData {
+    Vec3fArray verts;
+    Vec2fArray uvs;
+    Vec3fArray norms;
+    std::vector<int> vidx;
+    std::vector<int> tidx;
+    std::vector<int> nidx;
+    // welded vertices and one index into them per corner, see weld_vertices()
+    std::vector<MeshVertex> vertices;
+    std::vector<int> indices;
+    std::vector<MeshLod> lods; // coarser levels of indices, see build_lod_chain()
+    Vec3f bbox_min; // bounds of verts
+    Vec3f bbox_max;
+};
+
+// Maps the file, parses chunks split at line boundaries on the thread pool and merges them in
+// file order. Polygons are fan-triangulated and negative (relative) indices are resolved.
+// Missing uvs become (0,0) and missing normals are averaged from the faces around each position.
+// Fails on indices outside the arrays they refer to.
+bool parse_obj(const char *filename, ObjData &out);
+
+void compute_bounds(ObjData &obj);
+
+#endif //__OBJPARSER_H__
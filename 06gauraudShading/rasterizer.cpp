@@ -1,15 +1,45 @@
 #include "rasterizer.h"
 #include "model.h"
+#include "simplify.h"
+#include "meshlet.h"
+#include "threadpool.h"
+#include "scenebvh.h"
+#include <limits>
+#include <algorithm>
 // #include <cassert>
 
 
-Rasterizer::Rasterizer(int width, int height, Vec3f camera, Vec3f center, int depth, Model* model) {
+RenderContext::RenderContext() : ModelView(Matrix::identity(4)), Projection(Matrix::identity(4)), Viewport(Matrix::identity(4)),
+    light_dir(0, 0, 1), model(NULL), skinned(NULL), hdr(NULL), color(NULL), zbuffer(NULL), NormalMatrix(Matrix::identity(4)), light_eye(0, 0, 1) {
+}
+
+void RenderContext::prepare() {
+    NormalMatrix = ModelView.inverse_transpose();
+    light_eye = proj<3, 4>(ModelView * embed<4>(light_dir, 0.f)).normalize();
+}
+
+Vec3f RenderContext::position(int iface, int nthvert) const {
+    if (!skinned) return model->vert(iface, nthvert);
+    return skinned->positions[model->indices()[iface*3+nthvert]];
+}
+
+Vec3f RenderContext::normal(int iface, int nthvert) const {
+    if (!skinned) return model->normal(iface, nthvert);
+    return skinned->normals[model->indices()[iface*3+nthvert]];
+}
+
+Rasterizer::Rasterizer(int width, int height, Vec3f camera, Vec3f center, int depth, const Model* model) {
     this->width = width; 
     this->height = height; 
     this->camera = camera; 
     this->center = center; 
     this->depth = depth; 
     this->model = model; 
+    this->lodThreshold = 0.f;
+}
+
+void Rasterizer::setLodThreshold(float pixels) {
+    lodThreshold = pixels;
 }
 
 Matrix Rasterizer::viewport(int x, int y, int w, int h, int depth) {
@@ -76,7 +106,46 @@ Vec3f Rasterizer::barycentric2D(const Vec2f &A, const Vec2f &B, const Vec2f &C,
     float gamma = 1.f - alpha - beta;
     return Vec3f(alpha, beta, gamma);
 }
+static bool shade(IShader &shader, Vec3f bar, TGAColor &color) {
+    return shader.fragment(bar, color);
+}
+
+static bool shade(IShader &shader, Vec3f bar, Vec4f &color) {
+    return shader.fragment_hdr(bar, color);
+}
+
+void Rasterizer::triangle(Vec4f *pts, IShader &shader, RenderContext &ctx) {
+    if (!ctx.zbuffer || (!ctx.hdr && !ctx.color)) return;
+    if (ctx.hdr) rasterize<HDRImage, Vec4f, DepthBuffer>(pts, shader, *ctx.hdr, *ctx.zbuffer);
+    else rasterize<TGAImage, TGAColor, DepthBuffer>(pts, shader, *ctx.color, *ctx.zbuffer);
+}
+
 void Rasterizer::triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer) {
+    rasterize<TGAImage, TGAColor, TGAImage>(pts, shader, image, zbuffer);
+}
+
+void Rasterizer::triangle(Vec4f *pts, IShader &shader, HDRImage &image, TGAImage &zbuffer) {
+    rasterize<HDRImage, Vec4f, TGAImage>(pts, shader, image, zbuffer);
+}
+
+// 8-bit depth targets, as in the original lesson, and lazily cleared float ones hold the same values
+static float depth_get(const TGAImage &zbuffer, int x, int y) {
+    return zbuffer.get(x, y)[0];
+}
+
+static float depth_get(const DepthBuffer &zbuffer, int x, int y) {
+    return zbuffer.get(x, y);
+}
+
+static void depth_set(TGAImage &zbuffer, int x, int y, int depth) {
+    zbuffer.set(x, y, TGAColor(depth));
+}
+
+static void depth_set(DepthBuffer &zbuffer, int x, int y, int depth) {
+    zbuffer.at(x, y) = depth;
+}
+
+template <typename Target, typename Color, typename Depth> void Rasterizer::rasterize(Vec4f *pts, IShader &shader, Target &image, Depth &zbuffer) {
     Vec2f bboxmin( std::numeric_limits<float>::max(),  std::numeric_limits<float>::max());
     Vec2f bboxmax(-std::numeric_limits<float>::max(), -std::numeric_limits<float>::max());
     for (int i=0; i<3; i++) {
@@ -85,8 +154,13 @@ void Rasterizer::triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage
             bboxmax[j] = std::max(bboxmax[j], pts[i][j]/pts[i][3]);
         }
     }
+    // pixels off the target never passed the depth test's writes, so dropping them changes nothing
+    bboxmin.x = std::max(bboxmin.x, 0.f);
+    bboxmin.y = std::max(bboxmin.y, 0.f);
+    bboxmax.x = std::min(bboxmax.x, zbuffer.get_width() - 1.f);
+    bboxmax.y = std::min(bboxmax.y, zbuffer.get_height() - 1.f);
     Vec2i P;
-    TGAColor color;
+    Color color;
     for (P.x=bboxmin.x; P.x<=bboxmax.x; P.x++) {
         for (P.y=bboxmin.y; P.y<=bboxmax.y; P.y++) {
             Vec2f Pf(P[0], P[1]);
@@ -94,24 +168,33 @@ void Rasterizer::triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage
             float z = pts[0][2]*c.x + pts[1][2]*c.y + pts[2][2]*c.z;
             float w = pts[0][3]*c.x + pts[1][3]*c.y + pts[2][3]*c.z;
             int frag_depth = std::max(0, std::min(255, int(z/w+.5)));
-            if (c.x<0 || c.y<0 || c.z<0 || zbuffer.get(P.x, P.y)[0]>frag_depth) continue;
-            bool discard = shader.fragment(c, color);
+            if (c.x<0 || c.y<0 || c.z<0 || depth_get(zbuffer, P.x, P.y)>frag_depth) continue;
+            bool discard = shade(shader, c, color);
             if (!discard) {
-                zbuffer.set(P.x, P.y, TGAColor(frag_depth));
+                depth_set(zbuffer, P.x, P.y, frag_depth);
                 image.set(P.x, P.y, color);
             }
         }
     }
 }
-void Rasterizer::triangleWithTexPerspectiveCorrect(const Rasterizer::VertexData v[3], float *zbuffer, TGAImage &image, const TGAImage &texture) {
+void Rasterizer::triangleWithTexPerspectiveCorrect(const Rasterizer::VertexData v[3], DepthBuffer &depthbuffer, TGAImage &image, const ImageView &texture) {
+    triangleBand(v, depthbuffer, image, texture, 0, image.get_height() - 1, Vec3f(1, 1, 1));
+}
+
+void Rasterizer::triangleBand(const VertexData v[3], DepthBuffer &depthbuffer, TGAImage &image, const ImageView &texture, int y0, int y1, const Vec3f &tint) {
     Vec2f bboxmin(1e8, 1e8), bboxmax(-1e8, -1e8);
-    Vec2f clamp(image.get_width() - 1, image.get_height() - 1);
+    Vec2f clamp(image.get_width() - 1, std::min(y1, image.get_height() - 1));
     for (int i = 0; i < 3; i++) {
         bboxmin.x = std::max(0.f, std::min(bboxmin.x, v[i].screenXY.x));
-        bboxmin.y = std::max(0.f, std::min(bboxmin.y, v[i].screenXY.y));
+        bboxmin.y = std::max((float)y0, std::min(bboxmin.y, v[i].screenXY.y));
         bboxmax.x = std::min(clamp.x, std::max(bboxmax.x, v[i].screenXY.x));
         bboxmax.y = std::min(clamp.y, std::max(bboxmax.y, v[i].screenXY.y));
     }
+    if (bboxmin.x > bboxmax.x || bboxmin.y > bboxmax.y) return;
+    // lazily cleared tiles under the bbox are materialized once, then the buffer is used directly
+    depthbuffer.touch(bboxmin.x, bboxmin.y, bboxmax.x, bboxmax.y);
+    float *zbuffer = depthbuffer.buffer();
+    bool tinted = tint.x != 1.f || tint.y != 1.f || tint.z != 1.f;
 
     Vec2i P;
     for (P.x = bboxmin.x; P.x <= bboxmax.x; P.x++) {
@@ -129,7 +212,7 @@ void Rasterizer::triangleWithTexPerspectiveCorrect(const Rasterizer::VertexData
             float z_screen = (z_ndc + 1.f) * 0.5f * depth;
 
             // 深度测试
-            int idx = P.x + P.y * width;
+            int idx = P.x + P.y * depthbuffer.get_width();
             if (z_screen < zbuffer[idx]) {
                 zbuffer[idx] = z_screen;
 
@@ -138,57 +221,189 @@ void Rasterizer::triangleWithTexPerspectiveCorrect(const Rasterizer::VertexData
                 uv.x = std::max(0.f, std::min(1.f, uv.x));
                 uv.y = std::max(0.f, std::min(1.f, uv.y));
 
-                int texX = uv.x * (texture.get_width() - 1);
-                int texY = uv.y * (texture.get_height() - 1); // 这里纹理不反向
-                image.set(P.x, P.y, texture.get(texX, texY));
+                int texX = uv.x * (texture.width - 1);
+                int texY = uv.y * (texture.height - 1); // 这里纹理不反向
+                TGAColor color = texture.get(texX, texY);
+                if (tinted) {
+                    for (int k = 0; k < 3; k++) color.bgra[k] = std::min(255.f, color.bgra[k] * tint[2 - k]);
+                }
+                image.set(P.x, P.y, color);
             }
         }
     }
 }
 
-void Rasterizer::renderModelPerspective(Model *model, TGAImage &image, const TGAImage &texture , int depth, int width, int height) {
-    float *zbuffer = new float[width * height];
-    std::fill_n(zbuffer, width * height, std::numeric_limits<float>::max());
+std::future<bool> Rasterizer::renderModelPerspective(const Model *model, TGAImage &image, const ImageView &texture , int depth, int width, int height, const std::string &filename, AsyncImageWriter *writer, const SkinnedVertices *skinned) {
+    FramebufferPool &pool = FramebufferPool::global();
+    DepthBuffer zbuffer = pool.acquire_depth(width, height, std::numeric_limits<float>::max());
 
-    // Matrix ModelView = Matrix::identity(4);
+    Matrix ModelView = Matrix::identity(4);
     lookat(camera, center, Vec3f(0,-1,0), ModelView);
     Matrix viewportMat = viewport(0, 0, width, height, depth);
     ModelView[2][3] = -2.f; // 调整模型位置
     Matrix proj = projection(5.f, 100.f, 90.f, width, height);
 
-    for (int i = 0; i < model->nfaces(); i++) {
-        std::vector<int> face = model->face(i);
-        std::vector<int> texIndices = model->texIndices(i);
-        VertexData vdata[3];
-
-        for (int j = 0; j < 3; j++) {
-            Vec3f worldPos = model->vert(face[j]);
-            Vec2f uv = model->texture(texIndices[j]);
+    // every welded vertex is transformed at most once and shared by all triangles that use it
+    const std::vector<MeshVertex> &vertices = model->vertices();
+    Matrix clipFromModel = proj * ModelView;
+    std::vector<VertexData> transformed(vertices.size());
+    std::vector<char> done(vertices.size(), 0);
+    auto drawTriangles = [&](const int *tri, int ntris) {
+        for (int i = 0; i < ntris*3; i++) {
+            int v = tri[i];
+            if (done[v]) continue;
+            done[v] = 1;
+            Vec2f uv = vertices[v].uv;
             uv.y = 1 - uv.y;
 
-            Matrix clipCoord = proj * ModelView * v2m(worldPos);
+            Matrix clipCoord = clipFromModel * v2m(skinned ? skinned->positions[v] : vertices[v].pos);
             float w_clip = clipCoord[3][0];
             Vec3f ndc = Vec3f(clipCoord[0][0]/w_clip, clipCoord[1][0]/w_clip, clipCoord[2][0]/w_clip);
 
             // Vec2f screenXY = Vec2f((ndc.x + 1) * 0.5f * width, (ndc.y + 1) * 0.5f * height);
             // 视口变换后的x,y
             Vec3f ScreenCoords = m2v(viewportMat * v2m(ndc));
-            Vec2f screenXY = Vec2f(ScreenCoords.x, ScreenCoords.y);
-            
-            vdata[j].screenXY = screenXY;
-            vdata[j].ndcZ = ndc.z;
-            vdata[j].oneOverW = 1.f / w_clip;
-            vdata[j].uvOverW = uv * vdata[j].oneOverW;
+            transformed[v].screenXY = Vec2f(ScreenCoords.x, ScreenCoords.y);
+            transformed[v].ndcZ = ndc.z;
+            transformed[v].oneOverW = 1.f / w_clip;
+            transformed[v].uvOverW = uv * transformed[v].oneOverW;
         }
+        for (int t = 0; t < ntris; t++) {
+            VertexData vdata[3] = {transformed[tri[t*3]], transformed[tri[t*3+1]], transformed[tri[t*3+2]]};
+            Rasterizer::triangleWithTexPerspectiveCorrect(vdata, zbuffer, image, texture);
+        }
+    };
 
-        Rasterizer::triangleWithTexPerspectiveCorrect(vdata, zbuffer, image, texture);
+    Vec4f eye = ModelView.inverse() * Vec4f(0, 0, 0, 1);
+    Vec3f eyeModel(eye.x/eye.w, eye.y/eye.w, eye.z/eye.w);
+    // LOD from the distance to the nearest point of the bounding sphere; 90 degrees of fov span the height
+    Vec3f bboxCenter = (model->bbox_min() + model->bbox_max()) * .5f;
+    float distance = (bboxCenter - eyeModel).norm() - (model->bbox_max() - bboxCenter).norm();
+    float pixelsPerUnit = height * .5f / tan(90.f * 0.5f * M_PI / 180.f);
+    int lod = lodThreshold > 0 ? select_lod(model->lods(), std::max(distance, 1e-3f), pixelsPerUnit, lodThreshold) : -1;
+    if (lod >= 0) {
+        const std::vector<int> &indices = model->lods()[lod].indices;
+        drawTriangles(indices.data(), (int)indices.size()/3);
+    } else if (skinned) {
+        drawTriangles(model->indices().data(), (int)model->indices().size()/3);
+    } else {
+        // meshlets outside the frustum or facing away are dropped before any vertex work;
+        // triangles are not clipped against near and far here, so neither are meshlets
+        const std::vector<int> &indices = model->indices();
+        const std::vector<Meshlet> &meshlets = model->meshlets();
+        Frustum frustum = frustum_from_matrix(clipFromModel, false);
+        for (size_t m = 0; m < meshlets.size(); m++) {
+            if (meshlet_visible(meshlets[m], frustum, eyeModel))
+                drawTriangles(&indices[meshlets[m].first_index], meshlets[m].ntriangles);
+        }
     }
 
     // image.flip_vertically();
-    image.write_tga_file("../output.tga");
-    delete[] zbuffer;
+    pool.release(std::move(zbuffer));
+    if (writer) {
+        // the caller keeps rendering into image, so the writer gets a copy in a pooled frame
+        TGAImage frame = pool.acquire_color(image.get_width(), image.get_height(), image.get_bytespp(), false);
+        frame = image;
+        return writer->submit(std::move(frame), filename);
+    }
+    std::promise<bool> written;
+    written.set_value(image.write_tga_file(filename.c_str()));
+    return written.get_future();
 };
 
+void Rasterizer::renderInstances(const Model *model, const std::vector<Instance> &instances, TGAImage &image, const ImageView &texture, DepthBuffer &zbuffer, const SceneBVH *bvh) {
+    Matrix view = Matrix::identity(4);
+    lookat(camera, center, Vec3f(0,-1,0), view);
+    Matrix viewportMat = viewport(0, 0, width, height, depth);
+    Matrix clipFromWorld = projection(5.f, 100.f, 90.f, width, height) * view;
+    float pixelsPerUnit = height * .5f / tan(90.f * 0.5f * M_PI / 180.f);
+    Vec3f bboxCenter = (model->bbox_min() + model->bbox_max()) * .5f;
+    float bboxRadius = (model->bbox_max() - bboxCenter).norm();
+
+    // level 0 is the full mesh, level l+1 is lods()[l]; each only transforms the vertices it uses
+    const std::vector<MeshVertex> &vertices = model->vertices();
+    const std::vector<MeshLod> &lods = model->lods();
+    std::vector<const std::vector<int>*> levelIndices(1, &model->indices());
+    for (size_t l = 0; l < lods.size(); l++) levelIndices.push_back(&lods[l].indices);
+    std::vector<std::vector<int> > levelVertices(levelIndices.size());
+    std::vector<char> used(vertices.size());
+    for (size_t l = 0; l < levelIndices.size(); l++) {
+        std::fill(used.begin(), used.end(), 0);
+        for (size_t i = 0; i < levelIndices[l]->size(); i++) used[(*levelIndices[l])[i]] = 1;
+        for (size_t v = 0; v < used.size(); v++) if (used[v]) levelVertices[l].push_back((int)v);
+    }
+
+    // the hierarchy rejects whole groups of instances up front, otherwise each one is tested below
+    std::vector<int> drawn;
+    if (bvh) {
+        bvh->cull(frustum_from_matrix(clipFromWorld, false), drawn);
+    } else {
+        drawn.resize(instances.size());
+        for (size_t i = 0; i < drawn.size(); i++) drawn[i] = (int)i;
+    }
+
+    // instances go in batches so the post-transform buffer stays bounded
+    const int batchSize = 64;
+    const int bandRows = TiledTarget<float>::TILE_SIZE;  // bands never share a depth tile
+    int nbands = (height + bandRows - 1) / bandRows;
+    int nverts = (int)vertices.size();
+    std::vector<VertexData> transformed((size_t)std::min((int)drawn.size(), batchSize) * nverts);
+    std::vector<int> level(batchSize);
+    ThreadPool &pool = ThreadPool::global();
+    for (int first = 0; first < (int)drawn.size(); first += batchSize) {
+        int count = std::min(batchSize, (int)drawn.size() - first);
+        pool.parallel_for(0, count, [&](int b) {
+            const Instance &inst = instances[drawn[first + b]];
+            Matrix modelView = view * inst.transform;
+            Matrix clipFromModel = clipFromWorld * inst.transform;
+            level[b] = -1;
+            if (!bvh && !box_visible(frustum_from_matrix(clipFromModel, false), model->bbox_min(), model->bbox_max())) return;
+            Vec4f eye = modelView.inverse() * Vec4f(0, 0, 0, 1);
+            Vec3f eyeModel(eye.x/eye.w, eye.y/eye.w, eye.z/eye.w);
+            float distance = (bboxCenter - eyeModel).norm() - bboxRadius;
+            int lod = lodThreshold > 0 ? select_lod(lods, std::max(distance, 1e-3f), pixelsPerUnit, lodThreshold) : -1;
+            level[b] = lod + 1;
+            VertexData *out = &transformed[(size_t)b * nverts];
+            const std::vector<int> &todo = levelVertices[level[b]];
+            for (size_t i = 0; i < todo.size(); i++) {
+                int v = todo[i];
+                Vec2f uv = vertices[v].uv;
+                uv.y = 1 - uv.y;
+                Vec4f clip = clipFromModel * embed<4>(vertices[v].pos);
+                if (clip.w <= 0) {
+                    // at or behind the eye the projection would mirror it, triangles using it are dropped
+                    out[v].oneOverW = 0.f;
+                    continue;
+                }
+                Vec4f ndc = clip * (1.f / clip.w);
+                ndc.w = 1.f;
+                Vec4f screen = viewportMat * ndc;
+                out[v].screenXY = Vec2f(screen.x / screen.w, screen.y / screen.w);
+                out[v].ndcZ = ndc.z;
+                out[v].oneOverW = 1.f / clip.w;
+                out[v].uvOverW = uv * out[v].oneOverW;
+            }
+        });
+        // every band walks the batch in instance order, so depth ties resolve as in a serial draw
+        pool.parallel_for(0, nbands, [&](int band) {
+            int y0 = band * bandRows, y1 = std::min(height, y0 + bandRows) - 1;
+            for (int b = 0; b < count; b++) {
+                if (level[b] < 0) continue;
+                const VertexData *in = &transformed[(size_t)b * nverts];
+                const std::vector<int> &tri = *levelIndices[level[b]];
+                for (size_t t = 0; t + 2 < tri.size(); t += 3) {
+                    const VertexData &a = in[tri[t]], &c = in[tri[t+1]], &d = in[tri[t+2]];
+                    if (a.oneOverW <= 0 || c.oneOverW <= 0 || d.oneOverW <= 0) continue;
+                    if (std::max(a.screenXY.y, std::max(c.screenXY.y, d.screenXY.y)) < y0 ||
+                        std::min(a.screenXY.y, std::min(c.screenXY.y, d.screenXY.y)) > y1 + 1) continue;
+                    VertexData vdata[3] = {a, c, d};
+                    triangleBand(vdata, zbuffer, image, texture, y0, y1, instances[drawn[first + b]].tint);
+                }
+            }
+        });
+    }
+}
+
 Matrix Rasterizer::projection(float coeff) {
     Matrix m = Matrix::identity(4);
     m[3][2] = coeff;
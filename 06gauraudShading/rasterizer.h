@@ -1,13 +1,60 @@
 #ifndef RASTERIZER_H
 #define RASTERIZER_H
 
+#include <future>
 #include "tgaimage.h"
 #include "geometry.h"
 #include "model.h"
+#include "asyncwriter.h"
+#include "framebuffer.h"
+
+// Pipeline state of one view: transforms, lighting, the bound model and the targets.
+// Shaders and the Rasterizer get it passed in, so independent renders can run side by side.
+struct RenderContext {
+    Matrix ModelView;
+    Matrix Projection;
+    Matrix Viewport;
+    Vec3f light_dir;   // world space, towards the light
+    const Model *model;
+    const SkinnedVertices *skinned; // this frame's skin_vertices() output for model, if it is animated
+    HDRImage *hdr;     // fragments go here when set, to color otherwise
+    TGAImage *color;
+    DepthBuffer *zbuffer; // depth in [0,255] for triangle(), cleared to 0
+
+    // derived by prepare(), valid until the matrices or the light change
+    Matrix NormalMatrix; // inverse transpose of ModelView
+    Vec3f light_eye;     // light_dir in eye space
+
+    RenderContext();
+    void prepare();
+
+    // model-space corner attributes for vertex shaders, deformed when skinned is set
+    Vec3f position(int iface, int nthvert) const;
+    Vec3f normal(int iface, int nthvert) const;
+};
+
+// One copy of a mesh in an instanced draw.
+struct Instance {
+    Matrix transform; // model to world
+    Vec3f tint;       // multiplies the texture color
+
+    Instance() : transform(Matrix::identity(4)), tint(1, 1, 1) {}
+    Instance(const Matrix &transform, const Vec3f &tint=Vec3f(1, 1, 1)) : transform(transform), tint(tint) {}
+};
+
+class SceneBVH;
+
 struct IShader {
     virtual ~IShader() {}
-    virtual Vec4f vertex(int iface, int nthvert) = 0;
+    virtual Vec4f vertex(const RenderContext &ctx, int iface, int nthvert) = 0;
     virtual bool fragment(Vec3f bar, TGAColor &color) = 0;
+    // linear, unclamped rgba for HDR targets; by default the 8-bit color is taken as linear
+    virtual bool fragment_hdr(Vec3f bar, Vec4f &color) {
+        TGAColor c;
+        bool discard = fragment(bar, c);
+        color = Vec4f(c[2]/255.f, c[1]/255.f, c[0]/255.f, c[3]/255.f);
+        return discard;
+    }
 };
 class Rasterizer {
 public:
@@ -18,7 +65,7 @@ public:
         Vec2f uvOverW;  // uv/clip.w
     };
 
-    Rasterizer(int width, int height, Vec3f camera, Vec3f center, int depth, Model* model);
+    Rasterizer(int width, int height, Vec3f camera, Vec3f center, int depth, const Model* model);
 
     // Transformation matrices
     static Matrix viewport(int x, int y, int w, int h, int depth);
@@ -27,21 +74,36 @@ public:
 
     // Triangle rendering
     // void triangle(Vec4f *pts, IShader &shader, TGAImage &image, TGAImage &zbuffer);
-    void renderModelPerspective(Model *model, TGAImage &image, const TGAImage &texture, int depth, int weight, int height);
-    // void renderModelPerspective(Model *model, TGAImage &image, const TGAImage &texture);
-    void triangleWithTexPerspectiveCorrect(const Rasterizer::VertexData v[3], float *zbuffer, TGAImage &image, const TGAImage &texture);
+    // Coarser LODs are drawn while their error stays under this many pixels. The default 0 always
+    // draws the full mesh; LOD draws skip the meshlet culling of renderModelPerspective.
+    void setLodThreshold(float pixels);
+    // The finished frame is saved to filename; with a writer it is handed to it instead of being written
+    // synchronously. Either way the future reports whether the file was written. skinned replaces the bind
+    // pose positions; meshlet culling is skipped then, its bounds don't follow the joints.
+    std::future<bool> renderModelPerspective(const Model *model, TGAImage &image, const ImageView &texture, int depth, int weight, int height, const std::string &filename, AsyncImageWriter *writer=NULL, const SkinnedVertices *skinned=NULL);
+    // void renderModelPerspective(const Model *model, TGAImage &image, const TGAImage &texture);
+    void triangleWithTexPerspectiveCorrect(const Rasterizer::VertexData v[3], DepthBuffer &zbuffer, TGAImage &image, const ImageView &texture);
+    // Draws model once per instance with the camera of renderModelPerspective, the instance transform
+    // taking the place of the fixed model offset. Instances outside the frustum are dropped, the rest
+    // pick their own LOD when a threshold is set. Vertices are transformed in parallel, one instance per task, and the screen
+    // is rasterized in parallel bands of tile rows; the result matches drawing the instances in order.
+    // Nothing is clipped: triangles with a vertex at or behind the eye plane are skipped.
+    // With a bvh built over the instances' world boxes (see transform_box) culling walks the hierarchy
+    // instead of testing every instance.
+    void renderInstances(const Model *model, const std::vector<Instance> &instances, TGAImage &image, const ImageView &texture, DepthBuffer &zbuffer, const SceneBVH *bvh=NULL);
 
+    // into ctx.hdr or ctx.color, depth tested against ctx.zbuffer; nothing is drawn without them
+    void triangle(Vec4f* pts, IShader& shader, RenderContext &ctx);
     void triangle(Vec4f* pts, IShader& shader, TGAImage &image, TGAImage& zbuffer);
+    void triangle(Vec4f* pts, IShader& shader, HDRImage &image, TGAImage& zbuffer);
 
     Matrix projection(float coeff);
     
 
 private:
     int width, height, depth;
-    Model* model;
-    Matrix ModelView;
-    Matrix Viewport;
-    Matrix Projection;
+    const Model* model;
+    float lodThreshold;
 
     Vec3f camera;
     Vec3f center;
@@ -49,6 +111,9 @@ private:
     Matrix v2m(Vec3f v);
     Vec3f m2v(Matrix m);
     Vec3f barycentric2D(const Vec2f &A, const Vec2f &B, const Vec2f &C, const Vec2f &P);
+    // rows y0..y1 only, so bands of the same target can be filled concurrently
+    void triangleBand(const VertexData v[3], DepthBuffer &zbuffer, TGAImage &image, const ImageView &texture, int y0, int y1, const Vec3f &tint);
+    template <typename Target, typename Color, typename Depth> void rasterize(Vec4f *pts, IShader &shader, Target &image, Depth &zbuffer);
 
     
 };
@@ -0,0 +1,241 @@
+#include <cmath>
+#include <vector>
+#include <algorithm>
+#include <utility>
+#ifdef __SSE2__
+#include <xmmintrin.h>
+#endif
+#include "resample.h"
+#include "threadpool.h"
+
+namespace {
+
+float filter_support(ResampleFilter filter) {
+    switch (filter) {
+        case RESAMPLE_BOX:      return .5f;
+        case RESAMPLE_BILINEAR: return 1.f;
+        case RESAMPLE_LANCZOS3: return 3.f;
+    }
+    return 1.f;
+}
+
+float filter_weight(ResampleFilter filter, float x) {
+    x = std::fabs(x);
+    switch (filter) {
+        case RESAMPLE_BOX:
+            return x<=.5f ? 1.f : 0.f;
+        case RESAMPLE_BILINEAR:
+            return x<1.f ? 1.f-x : 0.f;
+        case RESAMPLE_LANCZOS3:
+            if (x<1e-6f) return 1.f;
+            if (x>=3.f) return 0.f;
+            return 3.f*std::sin(M_PI*x)*std::sin(M_PI*x/3.f) / (M_PI*M_PI*x*x);
+    }
+    return 0.f;
+}
+
+// For every destination sample, the first source sample it reads and a fixed number of weights.
+// Padding every destination sample to the same tap count keeps the inner loops branch-free.
+struct Contributions {
+    int ntaps;
+    std::vector<int> first;
+    std::vector<float> weights; // ntaps per destination sample
+    std::vector<float> interleaved; // the same for groups of four samples, tap by tap, for the grayscale SSE kernel
+
+    Contributions(int srcsize, int dstsize, ResampleFilter filter) : ntaps(0), first(dstsize), weights() {
+        float scale = (float)dstsize/srcsize;
+        float widen = scale<1.f ? 1.f/scale : 1.f; // stretch the kernel when minifying
+        float support = filter_support(filter)*widen;
+        ntaps = std::min(srcsize, (int)std::ceil(support*2.f)+1);
+        weights.assign((size_t)dstsize*ntaps, 0.f);
+        for (int i=0; i<dstsize; i++) {
+            float center = (i+.5f)/scale;
+            int lo = (int)std::floor(center-support+.5f);
+            lo = std::max(0, std::min(lo, srcsize-ntaps));
+            first[i] = lo;
+            float *w = &weights[(size_t)i*ntaps];
+            float sum = 0.f;
+            for (int t=0; t<ntaps; t++) {
+                w[t] = filter_weight(filter, (lo+t+.5f-center)/widen);
+                sum += w[t];
+            }
+            if (sum==0.f) { // kernel fell between samples: take the nearest one
+                int nearest = std::max(lo, std::min(lo+ntaps-1, (int)center));
+                w[nearest-lo] = sum = 1.f;
+            }
+            for (int t=0; t<ntaps; t++) w[t] /= sum;
+        }
+        interleaved.resize((size_t)dstsize/4*4*ntaps);
+        for (int i=0; i<dstsize/4*4; i++) {
+            for (int t=0; t<ntaps; t++) interleaved[((size_t)(i/4)*ntaps + t)*4 + i%4] = weights[(size_t)i*ntaps + t];
+        }
+    }
+};
+
+// one source row of float pixels filtered into w destination pixels; NC is a template
+// parameter so the channel loop unrolls and the tap loop is a straight multiply-add chain
+template <int NC> void filter_row(const Contributions &contrib, const float *row, float *out, int w) {
+    for (int x=0; x<w; x++) {
+        const float *wt = &contrib.weights[(size_t)x*contrib.ntaps];
+        const float *in = row + (size_t)contrib.first[x]*NC;
+        float acc[NC];
+        for (int c=0; c<NC; c++) acc[c] = 0.f;
+        for (int t=0; t<contrib.ntaps; t++) {
+            for (int c=0; c<NC; c++) acc[c] += wt[t]*in[t*NC+c];
+        }
+        for (int c=0; c<NC; c++) out[x*NC+c] = acc[c];
+    }
+}
+
+#ifdef __SSE2__
+// The SSE kernels keep the scalar order of the multiply-adds in every lane, so they give the same bits.
+
+// RGB and RGBA: one pixel per vector, the fourth lane of RGB reads the next pixel (or the row's
+// padding) and is dropped
+template <int NC> void filter_row_sse(const Contributions &contrib, const float *row, float *out, int w) {
+    for (int x=0; x<w; x++) {
+        const float *wt = &contrib.weights[(size_t)x*contrib.ntaps];
+        const float *in = row + (size_t)contrib.first[x]*NC;
+        __m128 acc = _mm_setzero_ps();
+        for (int t=0; t<contrib.ntaps; t++) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(wt[t]), _mm_loadu_ps(in+t*NC)));
+        }
+        if (NC==4) {
+            _mm_storeu_ps(out+x*4, acc);
+        } else {
+            float lanes[4];
+            _mm_storeu_ps(lanes, acc);
+            for (int c=0; c<NC; c++) out[x*NC+c] = lanes[c];
+        }
+    }
+}
+
+// grayscale: four destination pixels per vector with interleaved weights, their inputs loaded lane by lane
+template <> void filter_row_sse<1>(const Contributions &contrib, const float *row, float *out, int w) {
+    const int ntaps = contrib.ntaps;
+    int x = 0;
+    for (; x+4<=w; x+=4) {
+        const float *wt = &contrib.interleaved[(size_t)x*ntaps];
+        const float *in0 = row + contrib.first[x], *in1 = row + contrib.first[x+1];
+        const float *in2 = row + contrib.first[x+2], *in3 = row + contrib.first[x+3];
+        __m128 acc = _mm_setzero_ps();
+        for (int t=0; t<ntaps; t++) {
+            acc = _mm_add_ps(acc, _mm_mul_ps(_mm_loadu_ps(wt+t*4), _mm_setr_ps(in0[t], in1[t], in2[t], in3[t])));
+        }
+        _mm_storeu_ps(out+x, acc);
+    }
+    for (; x<w; x++) {
+        const float *wt = &contrib.weights[(size_t)x*ntaps];
+        const float *in = row + contrib.first[x];
+        float acc = 0.f;
+        for (int t=0; t<ntaps; t++) acc += wt[t]*in[t];
+        out[x] = acc;
+    }
+}
+#endif
+
+void filter_row(const Contributions &contrib, const float *row, float *out, int w, int nc, bool simd) {
+#ifdef __SSE2__
+    if (simd) {
+        switch (nc) {
+            case TGAImage::GRAYSCALE: filter_row_sse<1>(contrib, row, out, w); break;
+            case TGAImage::RGB:       filter_row_sse<3>(contrib, row, out, w); break;
+            case TGAImage::RGBA:      filter_row_sse<4>(contrib, row, out, w); break;
+        }
+        return;
+    }
+#endif
+    switch (nc) {
+        case TGAImage::GRAYSCALE: filter_row<1>(contrib, row, out, w); break;
+        case TGAImage::RGB:       filter_row<3>(contrib, row, out, w); break;
+        case TGAImage::RGBA:      filter_row<4>(contrib, row, out, w); break;
+    }
+}
+
+// a[i] += k*in[i]
+void axpy(float k, const float *in, float *a, size_t n, bool simd) {
+    size_t i = 0;
+#ifdef __SSE2__
+    if (simd) {
+        const __m128 vk = _mm_set1_ps(k);
+        for (; i+4<=n; i+=4) _mm_storeu_ps(a+i, _mm_add_ps(_mm_loadu_ps(a+i), _mm_mul_ps(vk, _mm_loadu_ps(in+i))));
+    }
+#endif
+    for (; i<n; i++) a[i] += k*in[i];
+}
+
+unsigned char to_byte(float v) {
+    v = v+.5f;
+    return (unsigned char)(v<0.f ? 0.f : (v>255.f ? 255.f : v));
+}
+
+// both passes, with or without the SSE kernels
+bool resample_passes(const ImageView &src, TGAImage &dst, int w, int h, ResampleFilter filter, bool simd) {
+    if (w<=0 || h<=0 || !src.origin || src.width<=0 || src.height<=0) return false;
+    const int nc = src.bytespp;
+    if (nc!=TGAImage::GRAYSCALE && nc!=TGAImage::RGB && nc!=TGAImage::RGBA) return false;
+    const bool premultiply = (nc==TGAImage::RGBA);
+    Contributions hcontrib(src.width,  w, filter);
+    Contributions vcontrib(src.height, h, filter);
+    ThreadPool &pool = ThreadPool::global();
+    const int rows_per_task = 16;
+
+    // horizontal pass: every source row becomes w float pixels
+    std::vector<float> tmp((size_t)src.height*w*nc);
+    pool.parallel_for(0, (src.height+rows_per_task-1)/rows_per_task, [&](int task) {
+        std::vector<float> row((size_t)src.width*nc + 1); // the RGB kernel loads one float past the last pixel
+        int yend = std::min(src.height, (task+1)*rows_per_task);
+        for (int y=task*rows_per_task; y<yend; y++) {
+            for (int x=0; x<src.width; x++) {
+                const unsigned char *p = src.pixel(x, y);
+                float *r = &row[(size_t)x*nc];
+                for (int c=0; c<nc; c++) r[c] = p[c];
+                if (premultiply) {
+                    float a = r[3]*(1.f/255.f);
+                    r[0] *= a; r[1] *= a; r[2] *= a;
+                }
+            }
+            filter_row(hcontrib, row.data(), &tmp[(size_t)y*w*nc], w, nc, simd);
+        }
+    });
+
+    // vertical pass: each output row is a weighted sum of whole contiguous rows, one axpy per tap
+    TGAImage res(w, h, nc);
+    unsigned char *data = res.buffer();
+    pool.parallel_for(0, (h+rows_per_task-1)/rows_per_task, [&](int task) {
+        std::vector<float> acc((size_t)w*nc);
+        int yend = std::min(h, (task+1)*rows_per_task);
+        for (int y=task*rows_per_task; y<yend; y++) {
+            std::fill(acc.begin(), acc.end(), 0.f);
+            const float *wt = &vcontrib.weights[(size_t)y*vcontrib.ntaps];
+            for (int t=0; t<vcontrib.ntaps; t++) {
+                axpy(wt[t], &tmp[(size_t)(vcontrib.first[y]+t)*w*nc], acc.data(), acc.size(), simd);
+            }
+            unsigned char *out = data + (size_t)y*w*nc;
+            if (premultiply) {
+                for (int x=0; x<w; x++) {
+                    float *p = &acc[(size_t)x*4];
+                    float inva = p[3]>.5f ? 255.f/p[3] : 0.f;
+                    out[x*4+0] = to_byte(p[0]*inva);
+                    out[x*4+1] = to_byte(p[1]*inva);
+                    out[x*4+2] = to_byte(p[2]*inva);
+                    out[x*4+3] = to_byte(p[3]);
+                }
+            } else {
+                for (size_t i=0; i<acc.size(); i++) out[i] = to_byte(acc[i]);
+            }
+        }
+    });
+    dst = std::move(res);
+    return true;
+}
+
+}
+
+bool resample(const ImageView &src, TGAImage &dst, int w, int h, ResampleFilter filter) {
+    return resample_passes(src, dst, w, h, filter, true);
+}
+
+bool resample_scalar(const ImageView &src, TGAImage &dst, int w, int h, ResampleFilter filter) {
+    return resample_passes(src, dst, w, h, filter, false);
+}
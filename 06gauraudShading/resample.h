@@ -0,0 +1,19 @@
+#ifndef __RESAMPLE_H__
+#define __RESAMPLE_H__
+
+#include "tgaimage.h"
+
+enum ResampleFilter {
+    RESAMPLE_BOX,      // area average, best for integer downscales and mip chains
+    RESAMPLE_BILINEAR, // tent filter, widened when minifying
+    RESAMPLE_LANCZOS3  // windowed sinc, sharpest, may ring on hard edges
+};
+
+// Separable resize of src into a new w x h image of the same format.
+// Each pass is spread over the global thread pool by rows; RGBA is filtered with premultiplied alpha.
+// With SSE the horizontal taps and the vertical multiply-adds run four floats at a time.
+bool resample(const ImageView &src, TGAImage &dst, int w, int h, ResampleFilter filter);
+// the same with the scalar loops only; the output is identical, it is the reference for the SSE kernels
+bool resample_scalar(const ImageView &src, TGAImage &dst, int w, int h, ResampleFilter filter);
+
+#endif //__RESAMPLE_H__
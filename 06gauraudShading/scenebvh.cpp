@@ -0,0 +1,150 @@
+#include <algorithm>
+#include <limits>
+#include "scenebvh.h"
+
+AABB transform_box(const Matrix &m, const AABB &box) {
+    AABB out;
+    for (int i=0; i<3; i++) {
+        out.min[i] = out.max[i] = m[i][3];
+        for (int j=0; j<3; j++) {
+            float a = m[i][j]*box.min[j], b = m[i][j]*box.max[j];
+            out.min[i] += std::min(a, b);
+            out.max[i] += std::max(a, b);
+        }
+    }
+    return out;
+}
+
+static AABB empty_box() {
+    float inf = std::numeric_limits<float>::max();
+    return AABB(Vec3f(inf, inf, inf), Vec3f(-inf, -inf, -inf));
+}
+
+static void grow(AABB &box, const AABB &other) {
+    for (int k=0; k<3; k++) {
+        box.min[k] = std::min(box.min[k], other.min[k]);
+        box.max[k] = std::max(box.max[k], other.max[k]);
+    }
+}
+
+static bool same_box(const AABB &a, const AABB &b) {
+    for (int k=0; k<3; k++) {
+        if (a.min[k]!=b.min[k] || a.max[k]!=b.max[k]) return false;
+    }
+    return true;
+}
+
+SceneBVH::SceneBVH() : nodes_(), items_(), leaf_of_(), boxes_() {
+}
+
+void SceneBVH::build(const std::vector<AABB> &boxes, int leaf_size) {
+    boxes_ = boxes;
+    nodes_.clear();
+    items_.resize(boxes.size());
+    leaf_of_.assign(boxes.size(), -1);
+    for (size_t i=0; i<boxes.size(); i++) items_[i] = (int)i;
+    if (boxes.empty()) return;
+    nodes_.reserve(2*boxes.size());
+    Node root;
+    root.parent = -1;
+    nodes_.push_back(root);
+    build_node(0, 0, (int)boxes.size(), std::max(1, leaf_size));
+}
+
+int SceneBVH::build_node(int node, int first, int count, int leaf_size) {
+    AABB box = empty_box(), centroids = empty_box();
+    for (int i=first; i<first+count; i++) {
+        const AABB &b = boxes_[items_[i]];
+        grow(box, b);
+        Vec3f c = (b.min + b.max)*.5f;
+        grow(centroids, AABB(c, c));
+    }
+    nodes_[node].box = box;
+    if (count<=leaf_size) {
+        nodes_[node].first = first;
+        nodes_[node].count = count;
+        for (int i=first; i<first+count; i++) leaf_of_[items_[i]] = node;
+        return node;
+    }
+
+    Vec3f extent = centroids.max - centroids.min;
+    int axis = extent.x>extent.y ? (extent.x>extent.z ? 0 : 2) : (extent.y>extent.z ? 1 : 2);
+    int half = count/2;
+    const std::vector<AABB> &boxes = boxes_;
+    std::nth_element(items_.begin()+first, items_.begin()+first+half, items_.begin()+first+count, [&boxes, axis](int a, int b) {
+        return boxes[a].min[axis]+boxes[a].max[axis] < boxes[b].min[axis]+boxes[b].max[axis];
+    });
+
+    int left = (int)nodes_.size();
+    Node child;
+    child.parent = node;
+    nodes_.push_back(child);
+    nodes_.push_back(child);
+    nodes_[node].first = left;
+    nodes_[node].count = 0;
+    build_node(left, first, half, leaf_size);
+    build_node(left+1, first+half, count-half, leaf_size);
+    return node;
+}
+
+// recomputes the node's box from its items or children, reports whether it changed
+bool SceneBVH::refit_node(int node) {
+    Node &n = nodes_[node];
+    AABB box = empty_box();
+    if (n.count) {
+        for (int i=n.first; i<n.first+n.count; i++) grow(box, boxes_[items_[i]]);
+    } else {
+        grow(box, nodes_[n.first].box);
+        grow(box, nodes_[n.first+1].box);
+    }
+    if (same_box(box, n.box)) return false;
+    n.box = box;
+    return true;
+}
+
+void SceneBVH::update(int item, const AABB &box) {
+    boxes_[item] = box;
+    for (int node=leaf_of_[item]; node>=0 && refit_node(node); node=nodes_[node].parent) {}
+}
+
+void SceneBVH::refit(const std::vector<AABB> &boxes) {
+    boxes_ = boxes;
+    for (int node=(int)nodes_.size()-1; node>=0; node--) refit_node(node);
+}
+
+// false when the box is outside one of the planes still set in mask; planes the box lies
+// entirely inside are cleared from mask, so nothing below has to test them again
+static bool box_in_planes(const AABB &box, const Frustum &frustum, int &mask) {
+    for (int i=0; i<6; i++) {
+        if (!(mask & (1<<i))) continue;
+        const Vec4f &p = frustum.planes[i];
+        // the corners furthest along and against the plane normal
+        Vec3f far(p[0]>0 ? box.max.x : box.min.x, p[1]>0 ? box.max.y : box.min.y, p[2]>0 ? box.max.z : box.min.z);
+        Vec3f near(p[0]>0 ? box.min.x : box.max.x, p[1]>0 ? box.min.y : box.max.y, p[2]>0 ? box.min.z : box.max.z);
+        if (p[0]*far.x + p[1]*far.y + p[2]*far.z + p[3] < 0) return false;
+        if (p[0]*near.x + p[1]*near.y + p[2]*near.z + p[3] >= 0) mask &= ~(1<<i);
+    }
+    return true;
+}
+
+void SceneBVH::cull(const Frustum &frustum, std::vector<int> &visible) const {
+    visible.clear();
+    if (nodes_.empty()) return;
+    std::vector<std::pair<int, int> > stack(1, std::make_pair(0, (1<<6)-1));
+    while (!stack.empty()) {
+        int node = stack.back().first, mask = stack.back().second;
+        stack.pop_back();
+        const Node &n = nodes_[node];
+        if (!box_in_planes(n.box, frustum, mask)) continue;
+        if (!n.count) {
+            stack.push_back(std::make_pair(n.first+1, mask));
+            stack.push_back(std::make_pair(n.first, mask));
+            continue;
+        }
+        for (int i=n.first; i<n.first+n.count; i++) {
+            int item_mask = mask;
+            if (!mask || box_in_planes(boxes_[items_[i]], frustum, item_mask)) visible.push_back(items_[i]);
+        }
+    }
+    std::sort(visible.begin(), visible.end());
+}
@@ -0,0 +1,60 @@
+#ifndef __SCENEBVH_H__
+#define __SCENEBVH_H__
+
+#include <vector>
+#include "geometry.h"
+#include "meshlet.h"
+
+struct AABB {
+    Vec3f min;
+    Vec3f max;
+
+    AABB() : min(), max() {}
+    AABB(const Vec3f &min, const Vec3f &max) : min(min), max(max) {}
+};
+
+// Bounds of the box after an affine transform (Arvo's method), e.g. an instance's world box from
+// its model's bbox_min()/bbox_max().
+AABB transform_box(const Matrix &m, const AABB &box);
+
+// Bounding volume hierarchy over a flat list of boxes, such as the world bounds of a scene's instances.
+// Culling walks the tree, dropping whole subtrees outside the frustum and accepting whole subtrees
+// inside it without testing their items. Items keep their indices, so callers address instances directly.
+class SceneBVH {
+public:
+    SceneBVH();
+
+    // median split along the longest axis of the centroids, at most leaf_size items per leaf
+    void build(const std::vector<AABB> &boxes, int leaf_size = 4);
+
+    // New bounds for one moved item; the enclosing nodes are refitted on the way up to the root,
+    // which stops early once a node's bounds come out unchanged. The topology is kept, so after
+    // large motions a rebuild gives tighter culling.
+    void update(int item, const AABB &box);
+    // the same for all items at once, one pass over the nodes
+    void refit(const std::vector<AABB> &boxes);
+
+    // indices of the items whose boxes are not entirely outside the frustum, in ascending order
+    void cull(const Frustum &frustum, std::vector<int> &visible) const;
+
+    int size() const { return (int)boxes_.size(); }
+    const AABB &bounds(int item) const { return boxes_[item]; }
+
+private:
+    struct Node {
+        AABB box;
+        int first;  // leaves: into items_; inner nodes: left child, the right one follows it
+        int count;  // items in a leaf, 0 for inner nodes
+        int parent; // -1 at the root
+    };
+
+    std::vector<Node> nodes_;  // children always come after their parent
+    std::vector<int> items_;   // item indices grouped by leaf
+    std::vector<int> leaf_of_; // item -> leaf node
+    std::vector<AABB> boxes_;
+
+    int build_node(int node, int first, int count, int leaf_size);
+    bool refit_node(int node);
+};
+
+#endif //__SCENEBVH_H__
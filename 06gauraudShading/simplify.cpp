@@ -0,0 +1,213 @@
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include "simplify.h"
+#include "meshopt.h"
+
+namespace {
+
+// symmetric 4x4 error quadric: xx xy xz xw yy yz yw zz zw ww, plus the number of planes in it
+struct Quadric {
+    double q[10];
+    double planes;
+
+    Quadric() : planes(0.0) { std::fill(q, q+10, 0.0); }
+
+    void add_plane(double a, double b, double c, double d) {
+        q[0] += a*a; q[1] += a*b; q[2] += a*c; q[3] += a*d;
+        q[4] += b*b; q[5] += b*c; q[6] += b*d;
+        q[7] += c*c; q[8] += c*d;
+        q[9] += d*d;
+        planes += 1.0;
+    }
+    Quadric &operator+=(const Quadric &o) {
+        for (int i=0; i<10; i++) q[i] += o.q[i];
+        planes += o.planes;
+        return *this;
+    }
+    // sum of squared distances from p to the accumulated planes
+    double error(const Vec3f &p) const {
+        double x = p.x, y = p.y, z = p.z;
+        return q[0]*x*x + 2*q[1]*x*y + 2*q[2]*x*z + 2*q[3]*x
+             + q[4]*y*y + 2*q[5]*y*z + 2*q[6]*y
+             + q[7]*z*z + 2*q[8]*z
+             + q[9];
+    }
+};
+
+struct Collapse {
+    double cost;
+    double mean; // cost per plane: mean squared distance
+    int from, to;
+    bool operator<(const Collapse &o) const { return cost<o.cost; }
+};
+
+bool same_position(const Vec3f &a, const Vec3f &b) {
+    return a.x==b.x && a.y==b.y && a.z==b.z;
+}
+
+bool position_less(const Vec3f &a, const Vec3f &b) {
+    if (a.x!=b.x) return a.x<b.x;
+    if (a.y!=b.y) return a.y<b.y;
+    return a.z<b.z;
+}
+
+// Vertices sharing a position with another welded vertex sit on a uv or normal seam; vertices of
+// edges that only one triangle uses (compared by position) sit on a border. Neither may move.
+void find_locked(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, std::vector<char> &locked, std::vector<int> &group_size) {
+    const size_t nverts = vertices.size();
+    std::vector<int> order(nverts);
+    for (size_t i=0; i<nverts; i++) order[i] = (int)i;
+    std::sort(order.begin(), order.end(), [&](int a, int b) { return position_less(vertices[a].pos, vertices[b].pos); });
+    std::vector<int> group(nverts);
+    int ngroups = 0;
+    for (size_t i=0; i<nverts; i++) {
+        if (i && !same_position(vertices[order[i]].pos, vertices[order[i-1]].pos)) ngroups++;
+        group[order[i]] = ngroups;
+    }
+    ngroups++;
+    std::vector<int> members(ngroups, 0);
+    for (size_t i=0; i<nverts; i++) members[group[i]]++;
+
+    std::vector<std::pair<int,int> > edges;
+    edges.reserve(indices.size());
+    for (size_t t=0; t+2<indices.size(); t+=3) {
+        for (int k=0; k<3; k++) {
+            int a = group[indices[t+k]], b = group[indices[t+(k+1)%3]];
+            if (a!=b) edges.push_back(std::make_pair(std::min(a, b), std::max(a, b)));
+        }
+    }
+    std::sort(edges.begin(), edges.end());
+    std::vector<char> border(ngroups, 0);
+    for (size_t i=0; i<edges.size(); ) {
+        size_t j = i+1;
+        while (j<edges.size() && edges[j]==edges[i]) j++;
+        if (j-i==1) border[edges[i].first] = border[edges[i].second] = 1;
+        i = j;
+    }
+
+    locked.resize(nverts);
+    group_size.resize(nverts);
+    for (size_t i=0; i<nverts; i++) {
+        group_size[i] = members[group[i]];
+        locked[i] = members[group[i]]>1 || border[group[i]];
+    }
+}
+
+Vec3f face_normal(const Vec3f &a, const Vec3f &b, const Vec3f &c) {
+    return (b-a).cross(c-a);
+}
+
+}
+
+void build_lod_chain(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, const float *ratios, int nratios, std::vector<MeshLod> &lods) {
+    lods.clear();
+    const size_t nverts = vertices.size();
+    const size_t ntris = indices.size()/3;
+    if (!ntris) return;
+
+    std::vector<char> locked;
+    std::vector<int> group_size;
+    find_locked(vertices, indices, locked, group_size);
+
+    // unweighted plane quadrics, so errors stay in squared model units; a level reports the
+    // largest root mean square distance of a collapsed vertex to the planes it absorbed
+    std::vector<Quadric> quadrics(nverts);
+    for (size_t t=0; t<ntris; t++) {
+        const Vec3f &a = vertices[indices[t*3]].pos, &b = vertices[indices[t*3+1]].pos, &c = vertices[indices[t*3+2]].pos;
+        Vec3f n = face_normal(a, b, c);
+        if (n.norm()<=0) continue;
+        n.normalize();
+        double d = -(n*a);
+        for (int k=0; k<3; k++) quadrics[indices[t*3+k]].add_plane(n.x, n.y, n.z, d);
+    }
+
+    std::vector<int> current(indices);
+    std::vector<int> offsets(nverts+1), adjacency, remap(nverts);
+    std::vector<char> touched(nverts);
+    std::vector<Collapse> collapses;
+    double max_error = 0.0;
+    bool stuck = false;
+    for (int level=0; level<nratios; level++) {
+        size_t target = (size_t)(ntris*ratios[level]);
+        // each pass collapses a set of independent edges, cheapest first
+        while (!stuck && current.size()/3>target) {
+            std::fill(offsets.begin(), offsets.end(), 0);
+            for (size_t i=0; i<current.size(); i++) offsets[current[i]+1]++;
+            for (size_t v=0; v<nverts; v++) offsets[v+1] += offsets[v];
+            adjacency.resize(current.size());
+            std::vector<int> fill(offsets.begin(), offsets.end()-1);
+            for (size_t i=0; i<current.size(); i++) adjacency[fill[current[i]]++] = (int)(i/3);
+
+            collapses.clear();
+            for (size_t i=0; i<current.size(); i++) {
+                int from = current[i], to = current[i-i%3 + (i+1)%3];
+                for (int dir=0; dir<2; dir++, std::swap(from, to)) {
+                    // a seam target would be ambiguous: which of its welded copies should the triangles use
+                    if (locked[from] || group_size[to]>1) continue;
+                    Quadric q = quadrics[from];
+                    q += quadrics[to];
+                    double cost = q.error(vertices[to].pos);
+                    Collapse c = {cost, q.planes>0 ? cost/q.planes : 0.0, from, to};
+                    collapses.push_back(c);
+                }
+            }
+            std::sort(collapses.begin(), collapses.end());
+
+            for (size_t v=0; v<nverts; v++) remap[v] = (int)v;
+            std::fill(touched.begin(), touched.end(), 0);
+            size_t removed = 0, needed = current.size()/3-target;
+            for (size_t i=0; i<collapses.size() && removed<needed; i++) {
+                const Collapse &c = collapses[i];
+                if (touched[c.from] || touched[c.to]) continue;
+                // reject collapses that would turn a surviving triangle around
+                bool flips = false;
+                int gone = 0;
+                for (int a=offsets[c.from]; a<offsets[c.from+1] && !flips; a++) {
+                    const int *tri = &current[adjacency[a]*3];
+                    if (tri[0]==c.to || tri[1]==c.to || tri[2]==c.to) { gone++; continue; }
+                    Vec3f p[3];
+                    for (int k=0; k<3; k++) p[k] = vertices[tri[k]].pos;
+                    Vec3f before = face_normal(p[0], p[1], p[2]);
+                    for (int k=0; k<3; k++) if (tri[k]==c.from) p[k] = vertices[c.to].pos;
+                    flips = before*face_normal(p[0], p[1], p[2]) <= 0;
+                }
+                if (flips) continue;
+                remap[c.from] = c.to;
+                quadrics[c.to] += quadrics[c.from];
+                for (int a=offsets[c.from]; a<offsets[c.from+1]; a++) {
+                    for (int k=0; k<3; k++) touched[current[adjacency[a]*3+k]] = 1;
+                }
+                removed += gone;
+                max_error = std::max(max_error, c.mean);
+            }
+            if (!removed) {
+                stuck = true;
+                break;
+            }
+            size_t out = 0;
+            for (size_t t=0; t<current.size(); t+=3) {
+                int a = remap[current[t]], b = remap[current[t+1]], c = remap[current[t+2]];
+                if (a==b || b==c || c==a) continue;
+                current[out++] = a;
+                current[out++] = b;
+                current[out++] = c;
+            }
+            current.resize(out);
+        }
+        MeshLod lod;
+        lod.indices = current;
+        optimize_vertex_cache(lod.indices, nverts);
+        lod.error = (float)std::sqrt(max_error);
+        lods.push_back(lod);
+    }
+}
+
+int select_lod(const std::vector<MeshLod> &lods, float distance, float pixels_per_unit, float max_error_pixels) {
+    int best = -1;
+    if (distance<=0) return best;
+    for (size_t i=0; i<lods.size(); i++) {
+        if (lods[i].error*pixels_per_unit/distance <= max_error_pixels) best = (int)i;
+    }
+    return best;
+}
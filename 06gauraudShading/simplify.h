@@ -0,0 +1,17 @@
+#ifndef __SIMPLIFY_H__
+#define __SIMPLIFY_H__
+
+#include <vector>
+#include "objparser.h"
+
+// Builds coarser index buffers over the same welded vertices by quadric-error edge collapses
+// (Garland-Heckbert), one level per entry of ratios: fractions of the original triangle count,
+// decreasing. Vertices on mesh borders and attribute seams never move, so outlines and uv layout
+// survive. A level stops early when no collapse is left that keeps those constraints.
+void build_lod_chain(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, const float *ratios, int nratios, std::vector<MeshLod> &lods);
+
+// Coarsest level whose error, projected at the given distance, stays under max_error_pixels.
+// pixels_per_unit is the on-screen size of one model unit at distance 1. -1 means the full mesh.
+int select_lod(const std::vector<MeshLod> &lods, float distance, float pixels_per_unit, float max_error_pixels);
+
+#endif //__SIMPLIFY_H__
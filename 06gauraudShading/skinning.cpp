@@ -0,0 +1,169 @@
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <utility>
+#ifdef __AVX__
+#include <immintrin.h>
+#endif
+#include "skinning.h"
+#include "threadpool.h"
+
+size_t Skin::size_bytes() const {
+    size_t bytes = 0;
+    for (int k=0; k<3; k++) bytes += (positions.c[k].capacity() + normals.c[k].capacity())*sizeof(float);
+    for (int k=0; k<SKIN_MAX_INFLUENCES; k++) bytes += joints[k].capacity()*sizeof(int) + weights[k].capacity()*sizeof(float);
+    return bytes;
+}
+
+JointMatrix joint_matrix(const Matrix &m) {
+    JointMatrix j;
+    for (int r=0; r<3; r++) {
+        for (int c=0; c<4; c++) j.m[r*4+c] = m[r][c];
+    }
+    return j;
+}
+
+bool load_skin_weights(const char *filename, int npositions, std::vector<int> joints[SKIN_MAX_INFLUENCES], std::vector<float> weights[SKIN_MAX_INFLUENCES]) {
+    std::ifstream in(filename);
+    if (!in) return false;
+    for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+        joints[k].assign(npositions, 0);
+        weights[k].assign(npositions, 0.f);
+    }
+    weights[0].assign(npositions, 1.f);
+    std::string line;
+    int n = 0;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        if (line.find_first_not_of(" \t\r") == std::string::npos) continue;
+        if (n>=npositions) return false;
+        std::istringstream iss(line);
+        std::vector<std::pair<float, int> > influences;
+        int joint;
+        float weight;
+        while (iss >> joint >> weight) {
+            if (weight>0 && joint>=0) influences.push_back(std::make_pair(weight, joint));
+        }
+        std::sort(influences.begin(), influences.end(), std::greater<std::pair<float, int> >());
+        if (influences.size()>SKIN_MAX_INFLUENCES) influences.resize(SKIN_MAX_INFLUENCES);
+        float sum = 0;
+        for (size_t k=0; k<influences.size(); k++) sum += influences[k].first;
+        for (size_t k=0; k<influences.size(); k++) {
+            joints[k][n] = influences[k].second;
+            weights[k][n] = influences[k].first/sum;
+        }
+        n++;
+    }
+    return n==npositions;
+}
+
+void build_skin(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, const std::vector<int> &position_of,
+                const std::vector<int> joints[SKIN_MAX_INFLUENCES], const std::vector<float> weights[SKIN_MAX_INFLUENCES], Skin &skin) {
+    size_t nverts = vertices.size();
+    skin.positions.resize(nverts);
+    skin.normals.resize(nverts);
+    for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+        skin.joints[k].assign(nverts, 0);
+        skin.weights[k].assign(nverts, 0.f);
+    }
+    for (size_t i=0; i<nverts; i++) {
+        skin.positions.set(i, vertices[i].pos);
+        skin.normals.set(i, vertices[i].normal);
+    }
+    // every corner of a welded vertex refers to the same position
+    for (size_t c=0; c<indices.size() && c<position_of.size(); c++) {
+        int v = indices[c], p = position_of[c];
+        if (p<0) continue;
+        for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+            skin.joints[k][v] = joints[k][p];
+            skin.weights[k][v] = weights[k][p];
+        }
+    }
+}
+
+// vertices [begin, end), one at a time
+static void skin_scalar(const Skin &skin, const JointMatrix *palette, SkinnedVertices &out, size_t begin, size_t end) {
+    for (size_t i=begin; i<end; i++) {
+        float b[12] = {0};
+        for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+            float w = skin.weights[k][i];
+            if (w==0) continue;
+            const float *m = palette[skin.joints[k][i]].m;
+            for (int e=0; e<12; e++) b[e] += w*m[e];
+        }
+        float px = skin.positions.c[0][i], py = skin.positions.c[1][i], pz = skin.positions.c[2][i];
+        float nx = skin.normals.c[0][i], ny = skin.normals.c[1][i], nz = skin.normals.c[2][i];
+        float len = 0;
+        for (int r=0; r<3; r++) {
+            out.positions.c[r][i] = b[r*4]*px + b[r*4+1]*py + b[r*4+2]*pz + b[r*4+3];
+            float n = b[r*4]*nx + b[r*4+1]*ny + b[r*4+2]*nz;
+            out.normals.c[r][i] = n;
+            len += n*n;
+        }
+        len = std::sqrt(len);
+        if (len>0) for (int r=0; r<3; r++) out.normals.c[r][i] /= len;
+    }
+}
+
+#ifdef __AVX__
+// element e of the palette entries of eight joints; loading the lanes one by one beats the AVX2 gather
+static inline __m256 gather_palette(const JointMatrix *palette, const int *joints, int e) {
+    return _mm256_setr_ps(palette[joints[0]].m[e], palette[joints[1]].m[e], palette[joints[2]].m[e], palette[joints[3]].m[e],
+                          palette[joints[4]].m[e], palette[joints[5]].m[e], palette[joints[6]].m[e], palette[joints[7]].m[e]);
+}
+
+// vertices [begin, end) in batches of eight, end-begin a multiple of 8
+static void skin_avx(const Skin &skin, const JointMatrix *palette, SkinnedVertices &out, size_t begin, size_t end) {
+    for (size_t i=begin; i<end; i+=8) {
+        // blend the joint matrices of each lane, then transform once
+        __m256 b[12];
+        for (int e=0; e<12; e++) b[e] = _mm256_setzero_ps();
+        for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+            __m256 w = _mm256_loadu_ps(&skin.weights[k][i]);
+            if (_mm256_movemask_ps(_mm256_cmp_ps(w, _mm256_setzero_ps(), _CMP_NEQ_OQ))==0) continue;
+            const int *joints = &skin.joints[k][i];
+            for (int e=0; e<12; e++) b[e] = _mm256_add_ps(b[e], _mm256_mul_ps(w, gather_palette(palette, joints, e)));
+        }
+        __m256 p[3], n[3];
+        for (int c=0; c<3; c++) {
+            p[c] = _mm256_loadu_ps(&skin.positions.c[c][i]);
+            n[c] = _mm256_loadu_ps(&skin.normals.c[c][i]);
+        }
+        __m256 len = _mm256_setzero_ps();
+        __m256 rn[3];
+        for (int r=0; r<3; r++) {
+            __m256 rp = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b[r*4], p[0]), _mm256_mul_ps(b[r*4+1], p[1])),
+                                      _mm256_add_ps(_mm256_mul_ps(b[r*4+2], p[2]), b[r*4+3]));
+            _mm256_storeu_ps(&out.positions.c[r][i], rp);
+            rn[r] = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(b[r*4], n[0]), _mm256_mul_ps(b[r*4+1], n[1])), _mm256_mul_ps(b[r*4+2], n[2]));
+            len = _mm256_add_ps(len, _mm256_mul_ps(rn[r], rn[r]));
+        }
+        // zero-length normals stay zero
+        len = _mm256_sqrt_ps(len);
+        __m256 nonzero = _mm256_cmp_ps(len, _mm256_setzero_ps(), _CMP_GT_OQ);
+        __m256 inv = _mm256_and_ps(nonzero, _mm256_div_ps(_mm256_set1_ps(1.f), len));
+        for (int r=0; r<3; r++) _mm256_storeu_ps(&out.normals.c[r][i], _mm256_mul_ps(rn[r], inv));
+    }
+}
+#endif
+
+void skin_vertices(const Skin &skin, const std::vector<JointMatrix> &palette, SkinnedVertices &out) {
+    size_t nverts = skin.size();
+    out.positions.resize(nverts);
+    out.normals.resize(nverts);
+    if (!nverts || palette.empty()) return;
+    // blocks are multiples of eight, only the last one can end in a partial batch
+    const size_t block = 2048;
+    int nblocks = (int)((nverts + block - 1)/block);
+    ThreadPool::global().parallel_for(0, nblocks, [&](int blk) {
+        size_t begin = blk*block, end = std::min(nverts, begin + block);
+#ifdef __AVX__
+        size_t batched = begin + (end-begin)/8*8;
+        skin_avx(skin, palette.data(), out, begin, batched);
+        begin = batched;
+#endif
+        skin_scalar(skin, palette.data(), out, begin, end);
+    });
+}
@@ -0,0 +1,53 @@
+#ifndef __SKINNING_H__
+#define __SKINNING_H__
+
+#include <vector>
+#include "geometry.h"
+#include "objparser.h"
+
+#define SKIN_MAX_INFLUENCES 4
+
+// Linear-blend skinning attributes of the welded vertices, one array per component so the
+// skinning loop streams them in batches. Weights of a vertex sum to one; unused slots have weight 0.
+struct Skin {
+    Vec3fArray positions; // bind pose
+    Vec3fArray normals;
+    std::vector<int> joints[SKIN_MAX_INFLUENCES];
+    std::vector<float> weights[SKIN_MAX_INFLUENCES];
+
+    size_t size() const { return positions.size(); }
+    bool empty() const { return positions.empty(); }
+    size_t size_bytes() const;
+};
+
+// Affine joint transform as the first three rows of a 4x4 matrix, row-major.
+// A palette entry is the joint's current transform times the inverse of its bind transform.
+struct JointMatrix {
+    float m[12];
+};
+
+JointMatrix joint_matrix(const Matrix &m);
+
+// Per-frame output of skin_vertices(), indexed like Model::vertices().
+struct SkinnedVertices {
+    Vec3fArray positions;
+    Vec3fArray normals; // unit length
+};
+
+// Reads <mesh>_skin.txt style influences: one line per OBJ position, in the order of the v lines,
+// with up to SKIN_MAX_INFLUENCES "joint weight" pairs; '#' starts a comment. Extra influences keep
+// the heaviest, weights are normalised and positions without any are bound to joint 0.
+// Returns false if the file can't be read or doesn't have npositions lines.
+bool load_skin_weights(const char *filename, int npositions, std::vector<int> joints[SKIN_MAX_INFLUENCES], std::vector<float> weights[SKIN_MAX_INFLUENCES]);
+
+// Expands per-position influences to the welded vertices. position_of gives the OBJ position of each
+// corner of indices, e.g. the v index buffer of the faces.
+void build_skin(const std::vector<MeshVertex> &vertices, const std::vector<int> &indices, const std::vector<int> &position_of,
+                const std::vector<int> joints[SKIN_MAX_INFLUENCES], const std::vector<float> weights[SKIN_MAX_INFLUENCES], Skin &skin);
+
+// Blends positions and normals with the palette, eight vertices at a time with AVX when it is
+// compiled in (cmake -DRENDERER_AVX=ON), spread over the thread pool.
+// Joint indices must be valid for the palette. Normals assume the joints scale uniformly.
+void skin_vertices(const Skin &skin, const std::vector<JointMatrix> &palette, SkinnedVertices &out);
+
+#endif //__SKINNING_H__
@@ -0,0 +1,51 @@
+#ifndef __TESTS_FIXTURES_H__
+#define __TESTS_FIXTURES_H__
+
+// Helpers shared by the test programs. Each test is its own executable returning non-zero on failure.
+#include <iostream>
+#include <fstream>
+#include <cmath>
+#include <string>
+#include <vector>
+#include "../geometry.h"
+
+// Prints "ok: what" or "FAILED: what" and passes ok through, so tests can count failures with
+// failed += !check(...).
+inline bool check(bool ok, const std::string &what) {
+    std::cout << (ok ? "ok: " : "FAILED: ") << what << std::endl;
+    return ok;
+}
+
+// Writes a unit uv sphere around the z axis as an OBJ with texture coordinates and normals,
+// counter-clockwise seen from outside. Only the triangles whose corners all have z below zmax are
+// kept, which cuts off a cap; the default keeps the whole sphere.
+inline bool write_sphere(const std::string &filename, int rings = 12, int segments = 16, float zmax = 2.f) {
+    std::ofstream out(filename.c_str());
+    std::vector<Vec3f> verts;
+    for (int r=0; r<=rings; r++) {
+        float theta = M_PI*r/rings;
+        for (int s=0; s<=segments; s++) {
+            float phi = 2*M_PI*s/segments;
+            Vec3f v(std::sin(theta)*std::cos(phi), std::sin(theta)*std::sin(phi), std::cos(theta));
+            verts.push_back(v);
+            out << "v " << v.x << " " << v.y << " " << v.z << "\n";
+            out << "vt " << (float)s/segments << " " << (float)r/rings << "\n";
+            out << "vn " << v.x << " " << v.y << " " << v.z << "\n";
+        }
+    }
+    for (int r=0; r<rings; r++) {
+        for (int s=0; s<segments; s++) {
+            int a = r*(segments+1)+s, b = a+segments+1;
+            int tris[2][3] = {{a, b, a+1}, {a+1, b, b+1}};
+            for (int t=0; t<2; t++) {
+                if (verts[tris[t][0]].z>=zmax || verts[tris[t][1]].z>=zmax || verts[tris[t][2]].z>=zmax) continue;
+                out << "f";
+                for (int k=0; k<3; k++) out << " " << tris[t][k]+1 << "/" << tris[t][k]+1 << "/" << tris[t][k]+1;
+                out << "\n";
+            }
+        }
+    }
+    return out.good();
+}
+
+#endif //__TESTS_FIXTURES_H__
@@ -0,0 +1,126 @@
+// Checks Rasterizer::renderInstances: the banded, parallel draw of many instances, with and without a
+// SceneBVH, must match drawing the instances one at a time in order, and an instance reaching behind
+// the eye must only cover what its triangles in front of the eye cover.
+// usage: test_render_instances [scratch directory]
+#include <iostream>
+#include <cstring>
+#include <limits>
+#include <string>
+#include <vector>
+#include "../rasterizer.h"
+#include "../assetcache.h"
+#include "../scenebvh.h"
+#include "fixtures.h"
+
+static const int width = 200;
+static const int height = 150;
+static const int depth = 255;
+static const Vec3f camera(0, 0, 12);
+static const Vec3f center(0, 0, 0);
+
+static Matrix place(const Vec3f &offset, float scale) {
+    Matrix m = Matrix::identity(4);
+    for (int i=0; i<3; i++) {
+        m[i][i] = scale;
+        m[i][3] = offset[i];
+    }
+    return m;
+}
+
+struct Frame {
+    TGAImage image;
+    DepthBuffer zbuffer;
+
+    Frame() : image(width, height, TGAImage::RGB), zbuffer(width, height, std::numeric_limits<float>::max()) {}
+};
+
+static int diff_pixels(const Frame &a, const Frame &b) {
+    int n = 0;
+    for (int y=0; y<height; y++) {
+        for (int x=0; x<width; x++) {
+            if (memcmp(a.image.get(x, y).bgra, b.image.get(x, y).bgra, 3) || a.zbuffer.get(x, y)!=b.zbuffer.get(x, y)) n++;
+        }
+    }
+    return n;
+}
+
+static bool covered(const Frame &f, int x, int y) {
+    return f.zbuffer.get(x, y)!=std::numeric_limits<float>::max();
+}
+
+static int covered_pixels(const Frame &f) {
+    int n = 0;
+    for (int y=0; y<height; y++) {
+        for (int x=0; x<width; x++) n += covered(f, x, y);
+    }
+    return n;
+}
+
+static int coverage_diff(const Frame &a, const Frame &b) {
+    int n = 0;
+    for (int y=0; y<height; y++) {
+        for (int x=0; x<width; x++) n += covered(a, x, y)!=covered(b, x, y);
+    }
+    return n;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = argc>1 ? argv[1] : ".";
+    std::string full = dir + "/render_instances_sphere.obj", front = dir + "/render_instances_front.obj";
+    // placed at camera.z-.5 with radius 2, corners with z >= .25 are at or behind the eye
+    if (!write_sphere(full, 16, 24) || !write_sphere(front, 16, 24, .25f)) {
+        std::cerr << "can't write the test meshes to " << dir << std::endl;
+        return 1;
+    }
+    ModelHandle sphere = AssetCache::global().model(full), front_part = AssetCache::global().model(front);
+    if (!sphere || !front_part) {
+        std::cerr << "can't load the test meshes" << std::endl;
+        return 1;
+    }
+
+    TGAImage checker(64, 64, TGAImage::RGB), flat(4, 4, TGAImage::RGB);
+    for (int y=0; y<64; y++) {
+        for (int x=0; x<64; x++) checker.set(x, y, TGAColor(x*4, y*4, (x^y)*4));
+    }
+    for (int y=0; y<4; y++) {
+        for (int x=0; x<4; x++) flat.set(x, y, TGAColor(200, 200, 200));
+    }
+
+    Rasterizer rasterizer(width, height, camera, center, depth, sphere.get());
+    rasterizer.setLodThreshold(.5f); // distant instances use the coarser levels
+    int failed = 0;
+
+    // overlapping rows of instances at several depths, so bands, batches and depth ties all come into play
+    std::vector<Instance> instances;
+    for (int i=0; i<150; i++) {
+        Vec3f offset((i%10)*1.5f-7, ((i/10)%5)*1.5f-3, -(i/50)*2.f + (i%7)*.1f);
+        instances.push_back(Instance(place(offset, 1.2f), Vec3f(1, (i%3) ? 1.f : .5f, (i%5) ? 1.f : .25f)));
+    }
+    instances.push_back(Instance(place(Vec3f(2, 0, camera.z-.5f), 2.f)));
+    std::vector<AABB> boxes;
+    for (size_t i=0; i<instances.size(); i++)
+        boxes.push_back(transform_box(instances[i].transform, AABB(sphere->bbox_min(), sphere->bbox_max())));
+    SceneBVH bvh;
+    bvh.build(boxes);
+
+    Frame serial, banded, culled;
+    for (size_t i=0; i<instances.size(); i++)
+        rasterizer.renderInstances(sphere.get(), std::vector<Instance>(1, instances[i]), serial.image, checker.view(), serial.zbuffer);
+    rasterizer.renderInstances(sphere.get(), instances, banded.image, checker.view(), banded.zbuffer);
+    rasterizer.renderInstances(sphere.get(), instances, culled.image, checker.view(), culled.zbuffer, &bvh);
+    failed += !check(covered_pixels(serial)>0, "instances are drawn");
+    failed += !check(diff_pixels(banded, serial)==0, "banded draw matches the serial one");
+    failed += !check(diff_pixels(culled, serial)==0, "bvh culled draw matches the serial one");
+
+    // the part behind the eye would project mirrored onto the other side of the screen
+    rasterizer.setLodThreshold(0);
+    Frame straddling, reference;
+    std::vector<Instance> eye(1, Instance(place(Vec3f(2, 0, camera.z-.5f), 2.f)));
+    rasterizer.renderInstances(sphere.get(), eye, straddling.image, flat.view(), straddling.zbuffer);
+    rasterizer.renderInstances(front_part.get(), eye, reference.image, flat.view(), reference.zbuffer);
+    int wrong = coverage_diff(straddling, reference);
+    if (wrong) std::cerr << wrong << " pixels differ from the part in front of the eye" << std::endl;
+    failed += !check(covered_pixels(reference)>0 && !wrong, "nothing behind the eye is drawn");
+
+    return failed ? 1 : 0;
+}
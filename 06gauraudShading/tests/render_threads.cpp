@@ -0,0 +1,116 @@
+// Renders one shared Model from several threads at once, each with its own RenderContext and targets,
+// and checks every thread's frames against a single-threaded reference. Data races are caught when
+// built with cmake -DRENDERER_TSAN=ON: ThreadSanitizer then fails the run with a non-zero exit code.
+// usage: test_render_threads [scratch directory]
+#include <iostream>
+#include <cmath>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../rasterizer.h"
+#include "../assetcache.h"
+#include "../framebuffer.h"
+#include "fixtures.h"
+
+static const int width = 160;
+static const int height = 120;
+static const int depth = 255;
+static const int nthreads = 4;
+static const int nviews = 3;
+
+struct LambertShader : public IShader {
+    Vec3f varying_int;
+
+    virtual Vec4f vertex(const RenderContext &ctx, int iface, int nthvert) {
+        Vec3f n = proj<3, 4>(ctx.NormalMatrix * embed<4>(ctx.normal(iface, nthvert), 0.f)).normalize();
+        varying_int[nthvert] = std::max(0.f, n*ctx.light_eye);
+        return ctx.Viewport * (ctx.Projection * (ctx.ModelView * embed<4>(ctx.position(iface, nthvert))));
+    }
+
+    virtual bool fragment(Vec3f bar, TGAColor &color) {
+        color = TGAColor(255, 255, 255)*(bar*varying_int);
+        return false;
+    }
+};
+
+// resolved color followed by the depth values of one view of the model
+static std::vector<unsigned char> render(const Model *model, int view) {
+    FramebufferPool &pool = FramebufferPool::global();
+    HDRImage hdr = pool.acquire_hdr(width, height);
+    DepthBuffer zbuffer = pool.acquire_depth(width, height, 0.f);
+    Vec3f camera(std::cos(view*.7f)*3.f, .5f*view, std::sin(view*.7f)*3.f);
+
+    RenderContext ctx;
+    Rasterizer rasterizer(width, height, camera, Vec3f(0, 0, 0), depth, model);
+    Rasterizer::lookat(camera, Vec3f(0, 0, 0), Vec3f(0, 1, 0), ctx.ModelView);
+    ctx.Projection = rasterizer.projection(-1.f/camera.norm());
+    ctx.Viewport = Rasterizer::viewport(width/8, height/8, width*3/4, height*3/4, depth);
+    ctx.light_dir = Vec3f(1, 1, 1).normalize();
+    ctx.model = model;
+    ctx.hdr = &hdr;
+    ctx.zbuffer = &zbuffer;
+    ctx.prepare();
+
+    LambertShader shader;
+    for (int i=0; i<model->nfaces(); i++) {
+        Vec4f pts[3];
+        for (int j=0; j<3; j++) pts[j] = shader.vertex(ctx, i, j);
+        rasterizer.triangle(pts, shader, ctx);
+    }
+
+    TGAImage color, depth_image;
+    resolve(hdr, color, ResolveSettings(1.f, TONEMAP_CLAMP, false));
+    depth_to_image(zbuffer, depth_image);
+    std::vector<unsigned char> frame(color.buffer(), color.buffer()+width*height*3);
+    frame.insert(frame.end(), depth_image.buffer(), depth_image.buffer()+width*height);
+    pool.release(std::move(hdr));
+    pool.release(std::move(zbuffer));
+    return frame;
+}
+
+int main(int argc, char **argv) {
+    std::string dir = argc>1 ? argv[1] : ".";
+    std::string obj = dir + "/render_threads_sphere.obj";
+    if (!write_sphere(obj)) {
+        std::cerr << "can't write " << obj << std::endl;
+        return 1;
+    }
+    ModelHandle model = AssetCache::global().model(obj);
+    if (!model || !model->nfaces()) {
+        std::cerr << "can't load " << obj << std::endl;
+        return 1;
+    }
+
+    std::vector<std::vector<unsigned char> > reference;
+    for (int v=0; v<nviews; v++) reference.push_back(render(model.get(), v));
+    for (int v=0; v<nviews; v++) {
+        size_t lit = 0;
+        for (size_t i=0; i<(size_t)width*height*3; i++) lit += reference[v][i]!=0;
+        if (!lit) {
+            std::cerr << "view " << v << " rendered nothing" << std::endl;
+            return 1;
+        }
+    }
+
+    // every thread renders every view, starting at a different one so they overlap in all combinations
+    std::vector<int> mismatches(nthreads, 0);
+    std::vector<std::thread> threads;
+    for (int t=0; t<nthreads; t++) {
+        threads.push_back(std::thread([&, t]() {
+            ModelHandle shared = model;
+            for (int k=0; k<nviews; k++) {
+                int v = (t+k)%nviews;
+                if (render(shared.get(), v)!=reference[v]) mismatches[t]++;
+            }
+        }));
+    }
+    for (size_t t=0; t<threads.size(); t++) threads[t].join();
+
+    int failed = 0;
+    for (int t=0; t<nthreads; t++) {
+        if (mismatches[t]) std::cerr << "thread " << t << ": " << mismatches[t] << " frames differ from the reference" << std::endl;
+        failed += mismatches[t];
+    }
+    check(!failed, "frames rendered concurrently match the serial ones");
+    return failed ? 1 : 0;
+}
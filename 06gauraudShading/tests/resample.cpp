@@ -0,0 +1,51 @@
+// resample() with its SSE kernels against resample_scalar(): every format, filter and a mix of up- and
+// downscales with sizes that aren't multiples of four must give byte-identical images.
+// usage: test_resample
+#include <iostream>
+#include <cstdlib>
+#include <cstring>
+#include <sstream>
+#include "../resample.h"
+#include "fixtures.h"
+
+static TGAImage random_image(int w, int h, int bpp) {
+    TGAImage img(w, h, bpp);
+    unsigned char *p = img.buffer();
+    // smooth gradients with noise on top, and some fully transparent pixels for the RGBA case
+    for (int y=0; y<h; y++) {
+        for (int x=0; x<w; x++) {
+            for (int c=0; c<bpp; c++) p[(y*w+x)*bpp+c] = (unsigned char)((x*7 + y*3 + c*50 + rand()%32) & 255);
+            if (bpp==TGAImage::RGBA && rand()%5==0) p[(y*w+x)*bpp+3] = 0;
+        }
+    }
+    return img;
+}
+
+int main() {
+    srand(1);
+    const int bpps[] = {TGAImage::GRAYSCALE, TGAImage::RGB, TGAImage::RGBA};
+    const ResampleFilter filters[] = {RESAMPLE_BOX, RESAMPLE_BILINEAR, RESAMPLE_LANCZOS3};
+    const char *filter_names[] = {"box", "bilinear", "lanczos3"};
+    const int sizes[][4] = {{37, 23, 13, 9}, {37, 23, 101, 55}, {64, 64, 32, 32}, {5, 3, 7, 2}, {50, 1, 3, 1}, {1, 40, 1, 17}};
+    int failed = 0;
+    for (int b=0; b<3; b++) {
+        for (int s=0; s<6; s++) {
+            TGAImage src = random_image(sizes[s][0], sizes[s][1], bpps[b]);
+            int w = sizes[s][2], h = sizes[s][3];
+            for (int f=0; f<3; f++) {
+                TGAImage simd, scalar;
+                bool ok = resample(src.view(), simd, w, h, filters[f]) && resample_scalar(src.view(), scalar, w, h, filters[f]);
+                ok = ok && simd.get_width()==w && simd.get_height()==h && scalar.get_width()==w && scalar.get_height()==h;
+                ok = ok && !memcmp(simd.buffer(), scalar.buffer(), (size_t)w*h*bpps[b]);
+                // flipped views step backwards through memory
+                ok = ok && resample(src.view().flipped_horizontally(), simd, w, h, filters[f]);
+                ok = ok && resample_scalar(src.view().flipped_horizontally(), scalar, w, h, filters[f]);
+                ok = ok && !memcmp(simd.buffer(), scalar.buffer(), (size_t)w*h*bpps[b]);
+                std::ostringstream what;
+                what << bpps[b] << " bpp " << sizes[s][0] << "x" << sizes[s][1] << " -> " << w << "x" << h << " " << filter_names[f];
+                failed += !check(ok, what.str());
+            }
+        }
+    }
+    return failed ? 1 : 0;
+}
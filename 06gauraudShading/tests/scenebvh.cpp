@@ -0,0 +1,119 @@
+// SceneBVH::cull against testing every box with box_visible, after build, update() and refit(),
+// for several views of a random scene and random box sizes.
+// usage: test_scenebvh
+#include <iostream>
+#include <cstdlib>
+#include <vector>
+#include "../rasterizer.h"
+#include "../scenebvh.h"
+#include "fixtures.h"
+
+static float random_float(float lo, float hi) {
+    return lo + (hi-lo)*(rand()/(float)RAND_MAX);
+}
+
+static AABB random_box(float extent) {
+    Vec3f c(random_float(-extent, extent), random_float(-extent, extent), random_float(-extent, extent));
+    Vec3f half(random_float(.1f, 3.f), random_float(.1f, 3.f), random_float(.1f, 3.f));
+    return AABB(c - half, c + half);
+}
+
+static std::vector<int> brute_force(const std::vector<AABB> &boxes, const Frustum &frustum) {
+    std::vector<int> visible;
+    for (size_t i=0; i<boxes.size(); i++) {
+        if (box_visible(frustum, boxes[i].min, boxes[i].max)) visible.push_back((int)i);
+    }
+    return visible;
+}
+
+static std::vector<Frustum> views() {
+    std::vector<Frustum> frusta;
+    Vec3f eyes[] = {Vec3f(0, 0, 12), Vec3f(40, 10, 0), Vec3f(-5, 60, -5), Vec3f(0, 0, 0)};
+    for (int i=0; i<4; i++) {
+        Matrix view = Matrix::identity(4);
+        Rasterizer::lookat(eyes[i], Vec3f(1, 2, 3), Vec3f(0, -1, 0), view);
+        Matrix proj = Rasterizer::projection(5.f, 100.f, 60.f + 20*i, 400, 300);
+        frusta.push_back(frustum_from_matrix(proj*view, i%2==0));
+    }
+    return frusta;
+}
+
+// every view culled by the bvh gives exactly the brute force result
+static int compare(const SceneBVH &bvh, const std::vector<AABB> &boxes, const char *what) {
+    std::vector<Frustum> frusta = views();
+    int failed = 0;
+    size_t visible_total = 0;
+    for (size_t f=0; f<frusta.size(); f++) {
+        std::vector<int> visible, expected = brute_force(boxes, frusta[f]);
+        bvh.cull(frusta[f], visible);
+        visible_total += visible.size();
+        if (visible!=expected) {
+            std::cerr << what << ", view " << f << ": " << visible.size() << " visible, " << expected.size() << " expected" << std::endl;
+            failed++;
+        }
+    }
+    // a large scene where nothing or everything is visible would not exercise the walk
+    if (boxes.size()>=100 && (!visible_total || visible_total==boxes.size()*frusta.size())) {
+        std::cerr << what << ": degenerate scene, " << visible_total << " visible" << std::endl;
+        failed++;
+    }
+    return !check(!failed, what);
+}
+
+int main() {
+    srand(1);
+    int failed = 0;
+    const int sizes[] = {1, 7, 1000, 5000};
+    for (int s=0; s<4; s++) {
+        int n = sizes[s];
+        std::vector<AABB> boxes;
+        for (int i=0; i<n; i++) boxes.push_back(random_box(60.f));
+        for (int leaf_size=1; leaf_size<=8; leaf_size*=8) {
+            std::vector<AABB> scene = boxes;
+            SceneBVH bvh;
+            bvh.build(scene, leaf_size);
+            std::cout << n << " boxes, leaf size " << leaf_size << std::endl;
+            if (bvh.size()!=n) {
+                std::cerr << "size " << bvh.size() << ", expected " << n << std::endl;
+                failed++;
+            }
+            failed += compare(bvh, scene, "after build");
+
+            // small moves, then some far across the scene, one item at a time
+            for (int i=0; i<n; i+=3) {
+                Vec3f d(random_float(-2, 2), random_float(-2, 2), random_float(-2, 2));
+                scene[i] = AABB(scene[i].min + d, scene[i].max + d);
+                bvh.update(i, scene[i]);
+            }
+            for (int i=1; i<n; i+=11) {
+                scene[i] = random_box(60.f);
+                bvh.update(i, scene[i]);
+            }
+            failed += compare(bvh, scene, "after update");
+
+            for (int i=0; i<n; i++) scene[i] = random_box(60.f);
+            bvh.refit(scene);
+            failed += compare(bvh, scene, "after refit");
+
+            for (int i=0; i<n; i++) {
+                const AABB &b = bvh.bounds(i);
+                if (b.min.x!=scene[i].min.x || b.max.z!=scene[i].max.z) {
+                    std::cerr << "bounds(" << i << ") are stale" << std::endl;
+                    failed++;
+                    break;
+                }
+            }
+        }
+    }
+
+    // an empty hierarchy culls to nothing
+    SceneBVH empty;
+    empty.build(std::vector<AABB>());
+    std::vector<int> visible(1, 0);
+    empty.cull(views()[0], visible);
+    if (!visible.empty()) {
+        std::cerr << "empty bvh reports visible items" << std::endl;
+        failed++;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,113 @@
+// skin_vertices() against a double precision reference on random weights and palettes, with vertex
+// counts around the batch of eight and the block size of the parallel split. Built once as
+// test_skinning, with whatever code path the renderer was configured with, and once as
+// test_skinning_avx against an AVX build of skinning.cpp (skipped on CPUs without AVX).
+// usage: test_skinning
+#include <iostream>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <vector>
+#include "../skinning.h"
+#include "fixtures.h"
+
+static float random_float(float lo, float hi) {
+    return lo + (hi-lo)*(rand()/(float)RAND_MAX);
+}
+
+// one to four influences per vertex with weights summing to one; every 97th vertex has none at all,
+// so its position collapses to the origin and its normal must stay zero
+static void random_skin(int nverts, int njoints, Skin &skin) {
+    skin.positions.resize(nverts);
+    skin.normals.resize(nverts);
+    for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+        skin.joints[k].assign(nverts, 0);
+        skin.weights[k].assign(nverts, 0.f);
+    }
+    for (int i=0; i<nverts; i++) {
+        skin.positions.set(i, Vec3f(random_float(-5, 5), random_float(-5, 5), random_float(-5, 5)));
+        skin.normals.set(i, Vec3f(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)).normalize());
+        if (i%97==96) continue;
+        int n = 1 + rand()%SKIN_MAX_INFLUENCES;
+        float sum = 0;
+        for (int k=0; k<n; k++) sum += skin.weights[k][i] = random_float(.05f, 1.f);
+        for (int k=0; k<n; k++) {
+            skin.weights[k][i] /= sum;
+            skin.joints[k][i] = rand()%njoints;
+        }
+    }
+}
+
+// rotation about a random axis, a uniform scale and a translation
+static JointMatrix random_joint() {
+    Vec3f axis = Vec3f(random_float(-1, 1), random_float(-1, 1), random_float(-1, 1)).normalize();
+    float angle = random_float(-M_PI, M_PI), scale = random_float(.5f, 2.f);
+    float c = std::cos(angle), s = std::sin(angle), t = 1-c;
+    float x = axis.x, y = axis.y, z = axis.z;
+    Matrix m = Matrix::identity(4);
+    float r[3][3] = {{t*x*x+c, t*x*y-s*z, t*x*z+s*y}, {t*x*y+s*z, t*y*y+c, t*y*z-s*x}, {t*x*z-s*y, t*y*z+s*x, t*z*z+c}};
+    for (int i=0; i<3; i++) {
+        for (int j=0; j<3; j++) m[i][j] = r[i][j]*scale;
+        m[i][3] = random_float(-10, 10);
+    }
+    return joint_matrix(m);
+}
+
+// largest deviation of out from the reference over all vertices
+static double max_error(const Skin &skin, const std::vector<JointMatrix> &palette, const SkinnedVertices &out) {
+    double worst = 0;
+    for (size_t i=0; i<skin.size(); i++) {
+        double b[12] = {0};
+        for (int k=0; k<SKIN_MAX_INFLUENCES; k++) {
+            for (int e=0; e<12; e++) b[e] += (double)skin.weights[k][i]*palette[skin.joints[k][i]].m[e];
+        }
+        Vec3f p = skin.positions[i], n = skin.normals[i];
+        double pos[3], nrm[3], len = 0;
+        for (int r=0; r<3; r++) {
+            pos[r] = b[r*4]*p.x + b[r*4+1]*p.y + b[r*4+2]*p.z + b[r*4+3];
+            nrm[r] = b[r*4]*n.x + b[r*4+1]*n.y + b[r*4+2]*n.z;
+            len += nrm[r]*nrm[r];
+        }
+        len = std::sqrt(len);
+        for (int r=0; r<3; r++) {
+            if (len>0) nrm[r] /= len;
+            worst = std::max(worst, std::fabs(pos[r]-out.positions.c[r][i]));
+            worst = std::max(worst, std::fabs(nrm[r]-out.normals.c[r][i]));
+        }
+    }
+    return worst;
+}
+
+int main() {
+#ifdef SKINNING_TEST_NEEDS_AVX
+    __builtin_cpu_init();
+    if (!__builtin_cpu_supports("avx")) {
+        std::cout << "skipped: the CPU has no AVX" << std::endl;
+        return 77;
+    }
+#endif
+    srand(1);
+    const int sizes[] = {1, 7, 8, 13, 2047, 2048+5, 3*2048, 5001};
+    int failed = 0;
+    for (int s=0; s<8; s++) {
+        Skin skin;
+        random_skin(sizes[s], 24, skin);
+        std::vector<JointMatrix> palette;
+        for (int j=0; j<24; j++) palette.push_back(random_joint());
+        SkinnedVertices out;
+        skin_vertices(skin, palette, out);
+        bool ok = out.positions.size()==skin.size() && out.normals.size()==skin.size();
+        double error = ok ? max_error(skin, palette, out) : 0;
+        std::ostringstream what;
+        what << sizes[s] << " vertices, max error " << error;
+        failed += !check(ok && error<1e-4, what.str());
+    }
+
+    // an empty palette leaves the output sized but untouched
+    Skin skin;
+    random_skin(5, 1, skin);
+    SkinnedVertices out;
+    skin_vertices(skin, std::vector<JointMatrix>(), out);
+    failed += !check(out.positions.size()==5 && out.normals.size()==5, "empty palette");
+    return failed ? 1 : 0;
+}
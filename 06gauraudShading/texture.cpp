@@ -0,0 +1,21 @@
+#include "texture.h"
+
+Texture::Texture() : image(), mapped(), view_() {
+}
+
+std::shared_ptr<const Texture> Texture::load(const std::string &filename) {
+    std::shared_ptr<Texture> tex = std::make_shared<Texture>();
+    if (!tex->mapped.open(filename.c_str()) && !tex->image.read_tga_file(filename.c_str())) {
+        return std::shared_ptr<const Texture>();
+    }
+    tex->view_ = (tex->mapped.is_open() ? tex->mapped.view() : tex->image.view()).flipped_vertically();
+    return tex;
+}
+
+const ImageView &Texture::view() const {
+    return view_;
+}
+
+size_t Texture::size_bytes() const {
+    return (size_t)view_.width*view_.height*view_.bytespp;
+}
@@ -0,0 +1,30 @@
+#ifndef __TEXTURE_H__
+#define __TEXTURE_H__
+
+#include <string>
+#include <memory>
+#include "tgaimage.h"
+
+// Immutable texture shared between models through TextureHandle.
+// Uncompressed files are sampled straight from the mapping, anything else is decoded into an image.
+// The view is flipped so that uv (0,0) is the first texel.
+class Texture {
+private:
+    TGAImage image;
+    MappedTGA mapped;
+    ImageView view_;
+
+    Texture(const Texture &);
+    Texture & operator =(const Texture &);
+public:
+    Texture();
+    // empty handle when the file can't be read
+    static std::shared_ptr<const Texture> load(const std::string &filename);
+    const ImageView &view() const;
+    // pixel memory behind the view, mapped or decoded
+    size_t size_bytes() const;
+};
+
+typedef std::shared_ptr<const Texture> TextureHandle;
+
+#endif //__TEXTURE_H__
@@ -3,7 +3,11 @@
 #include <string.h>
 #include <time.h>
 #include <math.h>
+#include <vector>
+#include <algorithm>
 #include "tgaimage.h"
+#include "threadpool.h"
+#include "resample.h"
 
 TGAImage::TGAImage() : data(NULL), width(0), height(0), bytespp(0) {
 }
@@ -20,23 +24,43 @@ TGAImage::TGAImage(const TGAImage &img) : data(NULL), width(img.width), height(i
     memcpy(data, img.data, nbytes);
 }
 
+TGAImage::TGAImage(TGAImage &&img) noexcept : data(img.data), width(img.width), height(img.height), bytespp(img.bytespp) {
+    img.data = NULL;
+    img.width = img.height = img.bytespp = 0;
+}
+
 TGAImage::~TGAImage() {
     if (data) delete [] data;
 }
 
 TGAImage & TGAImage::operator =(const TGAImage &img) {
     if (this != &img) {
-        if (data) delete [] data;
+        unsigned long nbytes = img.width*img.height*img.bytespp;
+        if (!data || nbytes != (unsigned long)width*height*bytespp) { // same-sized buffers are reused
+            if (data) delete [] data;
+            data = new unsigned char[nbytes];
+        }
         width  = img.width;
         height = img.height;
         bytespp = img.bytespp;
-        unsigned long nbytes = width*height*bytespp;
-        data = new unsigned char[nbytes];
         memcpy(data, img.data, nbytes);
     }
     return *this;
 }
 
+TGAImage & TGAImage::operator =(TGAImage &&img) noexcept {
+    if (this != &img) {
+        if (data) delete [] data;
+        data = img.data;
+        width  = img.width;
+        height = img.height;
+        bytespp = img.bytespp;
+        img.data = NULL;
+        img.width = img.height = img.bytespp = 0;
+    }
+    return *this;
+}
+
 bool TGAImage::read_tga_file(const char *filename) {
     if (data) delete [] data;
     data = NULL;
@@ -65,7 +89,12 @@ bool TGAImage::read_tga_file(const char *filename) {
     unsigned long nbytes = bytespp*width*height;
     data = new unsigned char[nbytes];
     if (3==header.datatypecode || 2==header.datatypecode) {
-        in.read((char *)data, nbytes);
+        // bottom-left files are read row by row into their final place instead of being flipped afterwards
+        unsigned long bytes_per_line = width*bytespp;
+        for (int j=0; j<height && in.good(); j++) {
+            int y = (header.imagedescriptor & 0x20) ? j : height-1-j;
+            in.read((char *)(data+y*bytes_per_line), bytes_per_line);
+        }
         if (!in.good()) {
             in.close();
             std::cerr << "an error occured while reading the data\n";
@@ -82,7 +111,7 @@ bool TGAImage::read_tga_file(const char *filename) {
         std::cerr << "unknown file format " << (int)header.datatypecode << "\n";
         return false;
     }
-    if (!(header.imagedescriptor & 0x20)) {
+    if (!(header.imagedescriptor & 0x20) && (10==header.datatypecode || 11==header.datatypecode)) {
         flip_vertically();
     }
     if (header.imagedescriptor & 0x10) {
@@ -142,17 +171,10 @@ bool TGAImage::load_rle_data(std::ifstream &in) {
     return true;
 }
 
-bool TGAImage::write_tga_file(const char *filename, bool rle) {
+bool TGAImage::write_tga_file(const char *filename, bool rle) const {
     unsigned char developer_area_ref[4] = {0, 0, 0, 0};
     unsigned char extension_area_ref[4] = {0, 0, 0, 0};
     unsigned char footer[18] = {'T','R','U','E','V','I','S','I','O','N','-','X','F','I','L','E','.','\0'};
-    std::ofstream out;
-    out.open (filename, std::ios::binary);
-    if (!out.is_open()) {
-        std::cerr << "can't open file " << filename << "\n";
-        out.close();
-        return false;
-    }
     TGA_Header header;
     memset((void *)&header, 0, sizeof(header));
     header.bitsperpixel = bytespp<<3;
@@ -160,38 +182,41 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     header.height = height;
     header.datatypecode = (bytespp==GRAYSCALE?(rle?11:3):(rle?10:2));
     header.imagedescriptor = 0x20; // top-left origin
-    out.write((char *)&header, sizeof(header));
-    if (!out.good()) {
+
+    std::ofstream out;
+    out.open (filename, std::ios::binary);
+    if (!out.is_open()) {
+        std::cerr << "can't open file " << filename << "\n";
         out.close();
-        std::cerr << "can't dump the tga file\n";
         return false;
     }
+    out.write((char *)&header, sizeof(header));
     if (!rle) {
         out.write((char *)data, width*height*bytespp);
-        if (!out.good()) {
-            std::cerr << "can't unload raw data\n";
-            out.close();
-            return false;
-        }
-    } else {
-        if (!unload_rle_data(out)) {
-            out.close();
-            std::cerr << "can't unload rle data\n";
-            return false;
+    } else if (width>0 && height>0) { // an empty image is only the header and footer
+        // The image is cut into bands of whole scanlines, about 64K pixels each, that are encoded
+        // independently on the thread pool and written in order. Packets never cross a band
+        // boundary, so the output depends only on the image and not on the number of threads.
+        ThreadPool &pool = ThreadPool::global();
+        const int band_rows = std::max(1, (1<<16)/width);
+        const int nbands = (height+band_rows-1)/band_rows;
+        const int window = std::min(nbands, 2*pool.size());
+        std::vector<std::vector<unsigned char> > bands(window, std::vector<unsigned char>((unsigned long)band_rows*width*(bytespp+1)));
+        std::vector<unsigned char *> ends(window);
+        for (int first=0; first<nbands && out.good(); first+=window) {
+            int n = std::min(window, nbands-first);
+            pool.parallel_for(0, n, [&](int i) {
+                unsigned long y0 = (unsigned long)(first+i)*band_rows;
+                unsigned long y1 = std::min((unsigned long)height, y0+band_rows);
+                ends[i] = unload_rle_data(bands[i].data(), y0*width, y1*width);
+            });
+            for (int i=0; i<n; i++) {
+                out.write((char *)bands[i].data(), ends[i]-bands[i].data());
+            }
         }
     }
     out.write((char *)developer_area_ref, sizeof(developer_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
     out.write((char *)extension_area_ref, sizeof(extension_area_ref));
-    if (!out.good()) {
-        std::cerr << "can't dump the tga file\n";
-        out.close();
-        return false;
-    }
     out.write((char *)footer, sizeof(footer));
     if (!out.good()) {
         std::cerr << "can't dump the tga file\n";
@@ -202,47 +227,71 @@ bool TGAImage::write_tga_file(const char *filename, bool rle) {
     return true;
 }
 
-// TODO: it is not necessary to break a raw chunk for two equal pixels (for the matter of the resulting size)
-bool TGAImage::unload_rle_data(std::ofstream &out) {
-    const unsigned char max_chunk_length = 128;
-    unsigned long npixels = width*height;
+// Pixels are compared as whole 32-bit words instead of byte by byte.
+// 3-byte pixels are assembled with shifts: a partial memcpy over a zeroed word defeats store forwarding.
+template <int BPP> static inline unsigned int load_pixel(const unsigned char *p);
+template <> inline unsigned int load_pixel<1>(const unsigned char *p) {
+    return p[0];
+}
+template <> inline unsigned int load_pixel<3>(const unsigned char *p) {
+    return p[0] | (p[1]<<8) | (p[2]<<16);
+}
+template <> inline unsigned int load_pixel<4>(const unsigned char *p) {
+    unsigned int v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// Writes the packets for npixels pixels to dst and returns the end of the written data.
+// dst must have room for npixels*(BPP+1) bytes, the worst case of one header per pixel.
+template <int BPP> static unsigned char *encode_rle(const unsigned char *pixels, unsigned long npixels, unsigned char *dst) {
+    const unsigned long max_chunk_length = 128;
+    // A run is worth its own packet once it is cheaper than carrying it inside a raw packet:
+    // breaking a raw packet costs one run header plus one header to resume the raw packet,
+    // so two equal grayscale pixels stay raw while two equal color pixels already pay off.
+    const unsigned long min_run_length = (BPP==1 ? 3 : 2);
+    unsigned long rawstart = 0;
     unsigned long curpix = 0;
     while (curpix<npixels) {
-        unsigned long chunkstart = curpix*bytespp;
-        unsigned long curbyte = curpix*bytespp;
-        unsigned char run_length = 1;
-        bool raw = true;
-        while (curpix+run_length<npixels && run_length<max_chunk_length) {
-            bool succ_eq = true;
-            for (int t=0; succ_eq && t<bytespp; t++) {
-                succ_eq = (data[curbyte+t]==data[curbyte+t+bytespp]);
-            }
-            curbyte += bytespp;
-            if (1==run_length) {
-                raw = !succ_eq;
-            }
-            if (raw && succ_eq) {
-                run_length--;
-                break;
-            }
-            if (!raw && !succ_eq) {
-                break;
-            }
-            run_length++;
+        unsigned int p = load_pixel<BPP>(pixels+curpix*BPP);
+        unsigned long run_end = curpix+1;
+        while (run_end<npixels && run_end-curpix<max_chunk_length && load_pixel<BPP>(pixels+run_end*BPP)==p) {
+            run_end++;
         }
-        curpix += run_length;
-        out.put(raw?run_length-1:run_length+127);
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        if (run_end-curpix<min_run_length) {
+            curpix = run_end; // too short, keep accumulating raw pixels
+            continue;
         }
-        out.write((char *)(data+chunkstart), (raw?run_length*bytespp:bytespp));
-        if (!out.good()) {
-            std::cerr << "can't dump the tga file\n";
-            return false;
+        while (rawstart<curpix) {
+            unsigned long n = std::min(curpix-rawstart, max_chunk_length);
+            *dst++ = (unsigned char)(n-1);
+            memcpy(dst, pixels+rawstart*BPP, n*BPP);
+            dst += n*BPP;
+            rawstart += n;
         }
+        *dst++ = (unsigned char)(run_end-curpix+127);
+        memcpy(dst, pixels+curpix*BPP, BPP);
+        dst += BPP;
+        curpix = rawstart = run_end;
     }
-    return true;
+    while (rawstart<npixels) {
+        unsigned long n = std::min(npixels-rawstart, max_chunk_length);
+        *dst++ = (unsigned char)(n-1);
+        memcpy(dst, pixels+rawstart*BPP, n*BPP);
+        dst += n*BPP;
+        rawstart += n;
+    }
+    return dst;
+}
+
+unsigned char *TGAImage::unload_rle_data(unsigned char *dst, unsigned long first, unsigned long last) const {
+    const unsigned char *pixels = data + first*bytespp;
+    switch (bytespp) {
+        case GRAYSCALE: return encode_rle<1>(pixels, last-first, dst);
+        case RGB:       return encode_rle<3>(pixels, last-first, dst);
+        case RGBA:      return encode_rle<4>(pixels, last-first, dst);
+    }
+    return dst;
 }
 
 TGAColor TGAImage::get(int x, int y) const {
@@ -282,13 +331,12 @@ int TGAImage::get_height() const {
 
 bool TGAImage::flip_horizontally() {
     if (!data) return false;
-    int half = width>>1;
-    for (int i=0; i<half; i++) {
-        for (int j=0; j<height; j++) {
-            TGAColor c1 = get(i, j);
-            TGAColor c2 = get(width-1-i, j);
-            set(i, j, c2);
-            set(width-1-i, j, c1);
+    unsigned long bytes_per_line = width*bytespp;
+    for (int j=0; j<height; j++) {
+        unsigned char *l = data + j*bytes_per_line;
+        unsigned char *r = l + bytes_per_line - bytespp;
+        for (; l<r; l+=bytespp, r-=bytespp) {
+            std::swap_ranges(l, l+bytespp, r);
         }
     }
     return true;
@@ -297,16 +345,10 @@ bool TGAImage::flip_horizontally() {
 bool TGAImage::flip_vertically() {
     if (!data) return false;
     unsigned long bytes_per_line = width*bytespp;
-    unsigned char *line = new unsigned char[bytes_per_line];
     int half = height>>1;
     for (int j=0; j<half; j++) {
-        unsigned long l1 = j*bytes_per_line;
-        unsigned long l2 = (height-1-j)*bytes_per_line;
-        memmove((void *)line,      (void *)(data+l1), bytes_per_line);
-        memmove((void *)(data+l1), (void *)(data+l2), bytes_per_line);
-        memmove((void *)(data+l2), (void *)line,      bytes_per_line);
+        std::swap_ranges(data+j*bytes_per_line, data+(j+1)*bytes_per_line, data+(height-1-j)*bytes_per_line);
     }
-    delete [] line;
     return true;
 }
 
@@ -314,43 +356,71 @@ unsigned char *TGAImage::buffer() {
     return data;
 }
 
+ImageView TGAImage::view() const {
+    return ImageView(data, width, height, bytespp, (long)width*bytespp);
+}
+
 void TGAImage::clear() {
     memset((void *)data, 0, width*height*bytespp);
 }
 
 bool TGAImage::scale(int w, int h) {
     if (w<=0 || h<=0 || !data) return false;
-    unsigned char *tdata = new unsigned char[w*h*bytespp];
-    int nscanline = 0;
-    int oscanline = 0;
-    int erry = 0;
-    unsigned long nlinebytes = w*bytespp;
-    unsigned long olinebytes = width*bytespp;
-    for (int j=0; j<height; j++) {
-        int errx = width-w;
-        int nx   = -bytespp;
-        int ox   = -bytespp;
-        for (int i=0; i<width; i++) {
-            ox += bytespp;
-            errx += w;
-            while (errx>=(int)width) {
-                errx -= width;
-                nx += bytespp;
-                memcpy(tdata+nscanline+nx, data+oscanline+ox, bytespp);
-            }
-        }
-        erry += h;
-        oscanline += olinebytes;
-        while (erry>=(int)height) {
-            if (erry>=(int)height<<1) // it means we jump over a scanline
-                memcpy(tdata+nscanline+nlinebytes, tdata+nscanline, nlinebytes);
-            erry -= height;
-            nscanline += nlinebytes;
-        }
+    return resample(view(), *this, w, h, RESAMPLE_BOX);
+}
+
+MappedTGA::MappedTGA() : file(), view_() {
+}
+
+MappedTGA::~MappedTGA() {
+    close();
+}
+
+bool MappedTGA::open(const char *filename) {
+    close();
+    if (!file.open(filename)) return false;
+    if (file.size()<sizeof(TGA_Header)) {
+        close();
+        std::cerr << "an error occured while reading the header\n";
+        return false;
+    }
+    TGA_Header header;
+    memcpy(&header, file.data(), sizeof(header));
+    int w = header.width;
+    int h = header.height;
+    int bpp = header.bitsperpixel>>3;
+    if (w<=0 || h<=0 || (bpp!=TGAImage::GRAYSCALE && bpp!=TGAImage::RGB && bpp!=TGAImage::RGBA)) {
+        close();
+        std::cerr << "bad bpp (or width/height) value\n";
+        return false;
     }
-    delete [] data;
-    data = tdata;
-    width = w;
-    height = h;
+    if ((2!=header.datatypecode && 3!=header.datatypecode) || header.colormaptype) {
+        close();
+        std::cerr << "only uncompressed files can be mapped\n";
+        return false;
+    }
+    unsigned long offset = sizeof(header) + (unsigned char)header.idlength;
+    unsigned long rowbytes = (unsigned long)w*bpp;
+    if (offset + rowbytes*h > file.size()) {
+        close();
+        std::cerr << "an error occured while reading the data\n";
+        return false;
+    }
+    view_ = ImageView(file.data() + offset, w, h, bpp, (long)rowbytes);
+    if (!(header.imagedescriptor & 0x20)) view_ = view_.flipped_vertically();
+    if (header.imagedescriptor & 0x10)    view_ = view_.flipped_horizontally();
     return true;
-}
\ No newline at end of file
+}
+
+void MappedTGA::close() {
+    file.close();
+    view_ = ImageView();
+}
+
+bool MappedTGA::is_open() const {
+    return file.is_open();
+}
+
+const ImageView &MappedTGA::view() const {
+    return view_;
+}
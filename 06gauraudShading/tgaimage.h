@@ -2,6 +2,7 @@
 #define __IMAGE_H__
 
 #include <fstream>
+#include "mappedfile.h"
 
 #pragma pack(push,1)
 struct TGA_Header {
@@ -62,6 +63,54 @@ struct TGAColor {
     }
 };
 
+// Non-owning, read-only window on pixels stored elsewhere.
+// Both strides are in bytes and may be negative, so flips, crops and transposes
+// only change the origin, the size and the strides; no pixel is ever moved.
+struct ImageView {
+    const unsigned char *origin; // pixel (0,0)
+    int width;
+    int height;
+    int bytespp;
+    long row_stride;
+    long pixel_stride;
+
+    ImageView() : origin(NULL), width(0), height(0), bytespp(0), row_stride(0), pixel_stride(0) {}
+    ImageView(const unsigned char *o, int w, int h, int bpp, long rs) : origin(o), width(w), height(h), bytespp(bpp), row_stride(rs), pixel_stride(bpp) {}
+    ImageView(const unsigned char *o, int w, int h, int bpp, long rs, long ps) : origin(o), width(w), height(h), bytespp(bpp), row_stride(rs), pixel_stride(ps) {}
+
+    const unsigned char *pixel(int x, int y) const {
+        return origin + y*row_stride + x*pixel_stride;
+    }
+
+    TGAColor get(int x, int y) const {
+        if (!origin || x<0 || y<0 || x>=width || y>=height) {
+            return TGAColor();
+        }
+        return TGAColor(pixel(x, y), bytespp);
+    }
+
+    ImageView flipped_horizontally() const {
+        return ImageView(pixel(width-1, 0), width, height, bytespp, row_stride, -pixel_stride);
+    }
+
+    ImageView flipped_vertically() const {
+        return ImageView(pixel(0, height-1), width, height, bytespp, -row_stride, pixel_stride);
+    }
+
+    ImageView transposed() const {
+        return ImageView(origin, height, width, bytespp, pixel_stride, row_stride);
+    }
+
+    // sub-rectangle clipped to the view
+    ImageView crop(int x, int y, int w, int h) const {
+        if (x<0) { w += x; x = 0; }
+        if (y<0) { h += y; y = 0; }
+        if (w>width-x)  w = width-x;
+        if (h>height-y) h = height-y;
+        if (w<=0 || h<=0) return ImageView();
+        return ImageView(pixel(x, y), w, h, bytespp, row_stride, pixel_stride);
+    }
+};
 
 class TGAImage {
 protected:
@@ -71,7 +120,9 @@ protected:
     int bytespp;
 
     bool   load_rle_data(std::ifstream &in);
-    bool unload_rle_data(std::ofstream &out);
+    // RLE-encodes pixels [first, last) to dst, which needs room for (last-first)*(bytespp+1) bytes;
+    // returns the end of the encoded packets
+    unsigned char *unload_rle_data(unsigned char *dst, unsigned long first, unsigned long last) const;
 public:
     enum Format {
         GRAYSCALE=1, RGB=3, RGBA=4
@@ -80,8 +131,9 @@ public:
     TGAImage();
     TGAImage(int w, int h, int bpp);
     TGAImage(const TGAImage &img);
+    TGAImage(TGAImage &&img) noexcept;
     bool read_tga_file(const char *filename);
-    bool write_tga_file(const char *filename, bool rle=true);
+    bool write_tga_file(const char *filename, bool rle=true) const;
     bool flip_horizontally();
     bool flip_vertically();
     bool scale(int w, int h);
@@ -90,11 +142,32 @@ public:
     bool set(int x, int y, const TGAColor &c);
     ~TGAImage();
     TGAImage & operator =(const TGAImage &img);
+    TGAImage & operator =(TGAImage &&img) noexcept;
     int get_width() const;
     int get_height() const;
     int get_bytespp();
     unsigned char *buffer();
+    ImageView view() const;
     void clear();
 };
 
+// Uncompressed TGA (datatypecode 2 or 3) mapped read-only into memory: the view points straight at the
+// pixel data in the file, with the file orientation absorbed by the strides. Nothing is copied or flipped.
+class MappedTGA {
+private:
+    MappedFile file;
+    ImageView view_;
+
+    MappedTGA(const MappedTGA &);
+    MappedTGA & operator =(const MappedTGA &);
+public:
+    MappedTGA();
+    ~MappedTGA();
+    // fails for RLE-compressed files, use TGAImage::read_tga_file for those
+    bool open(const char *filename);
+    void close();
+    bool is_open() const;
+    const ImageView &view() const;
+};
+
 #endif //__IMAGE_H__
\ No newline at end of file
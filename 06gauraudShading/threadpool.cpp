@@ -0,0 +1,102 @@
+#include <atomic>
+#include <exception>
+#include "threadpool.h"
+
+ThreadPool::ThreadPool(int nthreads) : workers(), tasks(), mutex(), cv(), stopping(false) {
+    if (nthreads<=0) nthreads = std::thread::hardware_concurrency();
+    if (nthreads<=0) nthreads = 1;
+    for (int i=0; i<nthreads; i++) {
+        workers.push_back(std::thread(&ThreadPool::worker_loop, this));
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    cv.notify_all();
+    for (size_t i=0; i<workers.size(); i++) workers[i].join();
+}
+
+int ThreadPool::size() const {
+    return (int)workers.size();
+}
+
+void ThreadPool::worker_loop() {
+    for (;;) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            cv.wait(lock, [this]() { return stopping || !tasks.empty(); });
+            if (tasks.empty()) return; // stopping and drained
+            task = std::move(tasks.front());
+            tasks.pop_front();
+        }
+        task();
+    }
+}
+
+namespace {
+struct ParallelForState {
+    std::atomic<int> next;
+    int end;
+    std::function<void(int)> body;
+    std::mutex mutex;
+    std::condition_variable cv;
+    int remaining;
+    std::atomic<bool> failed;
+    std::exception_ptr error; // the first exception thrown by body, guarded by mutex
+
+    // Grabs indices until none are left, then reports how many it has finished. Once body has
+    // thrown the remaining indices are only counted off, so the caller's wait still ends.
+    void run() {
+        int done = 0;
+        for (int i=next++; i<end; i=next++) {
+            if (!failed) {
+                try {
+                    body(i);
+                } catch (...) {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (!error) error = std::current_exception();
+                    failed = true;
+                }
+            }
+            done++;
+        }
+        if (!done) return;
+        std::lock_guard<std::mutex> lock(mutex);
+        remaining -= done;
+        if (!remaining) cv.notify_all();
+    }
+};
+}
+
+void ThreadPool::parallel_for(int begin, int end, const std::function<void(int)> &body) {
+    if (end<=begin) return;
+    if (end-begin==1 || workers.size()<2) {
+        for (int i=begin; i<end; i++) body(i);
+        return;
+    }
+    std::shared_ptr<ParallelForState> state = std::make_shared<ParallelForState>();
+    state->next = begin;
+    state->end = end;
+    state->body = body;
+    state->remaining = end-begin;
+    state->failed = false;
+    int nhelpers = std::min((int)workers.size(), end-begin) - 1;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int i=0; i<nhelpers; i++) tasks.push_back([state]() { state->run(); });
+    }
+    cv.notify_all();
+    state->run();
+    std::unique_lock<std::mutex> lock(state->mutex);
+    state->cv.wait(lock, [&state]() { return !state->remaining; });
+    if (state->error) std::rethrow_exception(state->error);
+}
+
+ThreadPool &ThreadPool::global() {
+    static ThreadPool pool;
+    return pool;
+}
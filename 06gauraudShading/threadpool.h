@@ -0,0 +1,50 @@
+#ifndef __THREADPOOL_H__
+#define __THREADPOOL_H__
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+
+// A fixed set of worker threads fed from one FIFO queue.
+class ThreadPool {
+private:
+    std::vector<std::thread> workers;
+    std::deque<std::function<void()> > tasks;
+    std::mutex mutex;
+    std::condition_variable cv;
+    bool stopping;
+
+    void worker_loop();
+public:
+    // nthreads<=0 picks std::thread::hardware_concurrency()
+    explicit ThreadPool(int nthreads=0);
+    ~ThreadPool();
+    int size() const;
+
+    template <typename F> std::future<typename std::result_of<F()>::type> submit(F f) {
+        typedef typename std::result_of<F()>::type R;
+        std::shared_ptr<std::packaged_task<R()> > task = std::make_shared<std::packaged_task<R()> >(f);
+        std::future<R> res = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            tasks.push_back([task]() { (*task)(); });
+        }
+        cv.notify_one();
+        return res;
+    }
+
+    // Runs body(i) for every i in [begin, end) and returns once all of them are done.
+    // The calling thread takes part in the work, so nested calls from a worker cannot deadlock.
+    // If body throws, the indices not yet started are skipped and the first exception is rethrown here.
+    void parallel_for(int begin, int end, const std::function<void(int)> &body);
+
+    // process-wide pool sized to the hardware
+    static ThreadPool &global();
+};
+
+#endif //__THREADPOOL_H__